@@ -2,6 +2,8 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <sys/time.h>
+#include <pthread.h>
+#include <unistd.h>
 /* Input & output functions */
 int getint() {
     int t;
@@ -86,6 +88,7 @@ __attribute((destructor)) void after_main() {
     fprintf(stderr, "TOTAL: %dH-%dM-%dS-%dus\n", _sysy_h[0], _sysy_m[0],
             _sysy_s[0], _sysy_us[0]);
 }
+struct timeval _sysy_start, _sysy_end;
 void _sysy_starttime(int lineno) {
     _sysy_l1[_sysy_idx] = lineno;
     gettimeofday(&_sysy_start, NULL);
@@ -103,3 +106,206 @@ void _sysy_stoptime(int lineno) {
     _sysy_m[_sysy_idx] %= 60;
     _sysy_idx++;
 }
+
+/* Fork-join thread pool implementation */
+/* pthread_create is weak so that programs not linked with -lpthread (old glibc)
+   still link, and parallel loops simply run on the calling thread */
+#pragma weak pthread_create
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    int nthreads;
+    unsigned generation;
+    int pending;
+    _sysy_loop_body body;
+    int begin, end;
+    void *ctx;
+} _sysy_pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                PTHREAD_COND_INITIALIZER};
+
+/* static schedule: thread t runs the t-th of nthreads equal chunks */
+static void _sysy_run_chunk(int thread) {
+    long long n = (long long)_sysy_pool.end - _sysy_pool.begin;
+    int begin = _sysy_pool.begin + (int)(n * thread / _sysy_pool.nthreads);
+    int end = _sysy_pool.begin + (int)(n * (thread + 1) / _sysy_pool.nthreads);
+    if (begin < end)
+        _sysy_pool.body(begin, end, _sysy_pool.ctx, thread);
+}
+static void *_sysy_worker(void *arg) {
+    int thread = (int)(long)arg;
+    unsigned seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&_sysy_pool.lock);
+        while (_sysy_pool.generation == seen)
+            pthread_cond_wait(&_sysy_pool.start, &_sysy_pool.lock);
+        seen = _sysy_pool.generation;
+        pthread_mutex_unlock(&_sysy_pool.lock);
+        _sysy_run_chunk(thread);
+        pthread_mutex_lock(&_sysy_pool.lock);
+        if (--_sysy_pool.pending == 0)
+            pthread_cond_signal(&_sysy_pool.done);
+        pthread_mutex_unlock(&_sysy_pool.lock);
+    }
+    return NULL;
+}
+static void _sysy_pool_init() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    _sysy_pool.nthreads = cpus < 1 ? 1 : cpus > _SYSY_MAX_THREADS ? _SYSY_MAX_THREADS : (int)cpus;
+    if (!pthread_create)
+        _sysy_pool.nthreads = 1;
+    for (int t = 1; t < _sysy_pool.nthreads; t++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, _sysy_worker, (void *)(long)t) != 0) {
+            _sysy_pool.nthreads = t;
+            break;
+        }
+    }
+}
+void _sysy_parallel_for(_sysy_loop_body body, int begin, int end, void *ctx) {
+    if (!_sysy_pool.nthreads)
+        _sysy_pool_init();
+    if (_sysy_pool.nthreads == 1) {
+        body(begin, end, ctx, 0);
+        return;
+    }
+    pthread_mutex_lock(&_sysy_pool.lock);
+    _sysy_pool.body = body;
+    _sysy_pool.begin = begin;
+    _sysy_pool.end = end;
+    _sysy_pool.ctx = ctx;
+    _sysy_pool.pending = _sysy_pool.nthreads - 1;
+    _sysy_pool.generation++;
+    pthread_cond_broadcast(&_sysy_pool.start);
+    pthread_mutex_unlock(&_sysy_pool.lock);
+    _sysy_run_chunk(0);
+    pthread_mutex_lock(&_sysy_pool.lock);
+    while (_sysy_pool.pending)
+        pthread_cond_wait(&_sysy_pool.done, &_sysy_pool.lock);
+    pthread_mutex_unlock(&_sysy_pool.lock);
+}
+
+/* Matrix multiply kernels */
+/* C is computed in 4x4 tiles kept in registers, over blocks of _SYSY_MM_KB rows of B
+   (_SYSY_MM_KB x _SYSY_MM_NB elements stay in cache while every row of A uses them);
+   each element still adds its products in increasing p */
+#define _SYSY_MM_NB 64
+#define _SYSY_MM_KB 256
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+/* unsigned arithmetic wraps on overflow like the 32-bit SysY int */
+static void _sysy_mm_tile_i32(int p0, int p1, const int *a, int lda, const int *b, int ldb,
+                              int *c, int ldc) {
+#ifdef __ARM_NEON
+    uint32x4_t c0 = vld1q_u32((unsigned *)c), c1 = vld1q_u32((unsigned *)c + ldc);
+    uint32x4_t c2 = vld1q_u32((unsigned *)c + 2 * ldc), c3 = vld1q_u32((unsigned *)c + 3 * ldc);
+    for (int p = p0; p < p1; p++) {
+        uint32x4_t bp = vld1q_u32((const unsigned *)b + p * ldb);
+        c0 = vmlaq_n_u32(c0, bp, a[p]);
+        c1 = vmlaq_n_u32(c1, bp, a[lda + p]);
+        c2 = vmlaq_n_u32(c2, bp, a[2 * lda + p]);
+        c3 = vmlaq_n_u32(c3, bp, a[3 * lda + p]);
+    }
+    vst1q_u32((unsigned *)c, c0);
+    vst1q_u32((unsigned *)c + ldc, c1);
+    vst1q_u32((unsigned *)c + 2 * ldc, c2);
+    vst1q_u32((unsigned *)c + 3 * ldc, c3);
+#else
+    unsigned acc[4][4];
+    for (int r = 0; r < 4; r++)
+        for (int j = 0; j < 4; j++)
+            acc[r][j] = c[r * ldc + j];
+    for (int p = p0; p < p1; p++)
+        for (int r = 0; r < 4; r++)
+            for (int j = 0; j < 4; j++)
+                acc[r][j] += (unsigned)a[r * lda + p] * (unsigned)b[p * ldb + j];
+    for (int r = 0; r < 4; r++)
+        for (int j = 0; j < 4; j++)
+            c[r * ldc + j] = (int)acc[r][j];
+#endif
+}
+static void _sysy_mm_edge_i32(int rows, int cols, int p0, int p1, const int *a, int lda,
+                              const int *b, int ldb, int *c, int ldc) {
+    for (int r = 0; r < rows; r++)
+        for (int j = 0; j < cols; j++) {
+            unsigned acc = c[r * ldc + j];
+            for (int p = p0; p < p1; p++)
+                acc += (unsigned)a[r * lda + p] * (unsigned)b[p * ldb + j];
+            c[r * ldc + j] = (int)acc;
+        }
+}
+void _sysy_matmul_i32(int m, int n, int k, const int *a, int lda, const int *b, int ldb,
+                      int *c, int ldc, int accumulate) {
+    if (!accumulate)
+        for (int i = 0; i < m; i++)
+            for (int j = 0; j < n; j++)
+                c[i * ldc + j] = 0;
+    for (int j0 = 0; j0 < n; j0 += _SYSY_MM_NB) {
+        int j1 = n - j0 < _SYSY_MM_NB ? n : j0 + _SYSY_MM_NB;
+        for (int p0 = 0; p0 < k; p0 += _SYSY_MM_KB) {
+            int p1 = k - p0 < _SYSY_MM_KB ? k : p0 + _SYSY_MM_KB;
+            int i = 0;
+            for (; i + 4 <= m; i += 4) {
+                int j = j0;
+                for (; j + 4 <= j1; j += 4)
+                    _sysy_mm_tile_i32(p0, p1, a + i * lda, lda, b + j, ldb, c + i * ldc + j, ldc);
+                _sysy_mm_edge_i32(4, j1 - j, p0, p1, a + i * lda, lda, b + j, ldb, c + i * ldc + j, ldc);
+            }
+            _sysy_mm_edge_i32(m - i, j1 - j0, p0, p1, a + i * lda, lda, b + j0, ldb, c + i * ldc + j0, ldc);
+        }
+    }
+}
+/* NEON flushes denormals to zero, so the float kernel stays on VFP;
+   products must not be fused into the additions, which would change the rounding */
+#if defined(__GNUC__) && !defined(__clang__)
+#define _SYSY_NO_FP_CONTRACT __attribute__((optimize("fp-contract=off")))
+#else
+#define _SYSY_NO_FP_CONTRACT
+#endif
+_SYSY_NO_FP_CONTRACT
+static void _sysy_mm_tile_f32(int p0, int p1, const float *a, int lda, const float *b, int ldb,
+                              float *c, int ldc) {
+    float acc[4][4];
+    for (int r = 0; r < 4; r++)
+        for (int j = 0; j < 4; j++)
+            acc[r][j] = c[r * ldc + j];
+    for (int p = p0; p < p1; p++)
+        for (int r = 0; r < 4; r++)
+            for (int j = 0; j < 4; j++)
+                acc[r][j] += a[r * lda + p] * b[p * ldb + j];
+    for (int r = 0; r < 4; r++)
+        for (int j = 0; j < 4; j++)
+            c[r * ldc + j] = acc[r][j];
+}
+_SYSY_NO_FP_CONTRACT
+static void _sysy_mm_edge_f32(int rows, int cols, int p0, int p1, const float *a, int lda,
+                              const float *b, int ldb, float *c, int ldc) {
+    for (int r = 0; r < rows; r++)
+        for (int j = 0; j < cols; j++) {
+            float acc = c[r * ldc + j];
+            for (int p = p0; p < p1; p++)
+                acc += a[r * lda + p] * b[p * ldb + j];
+            c[r * ldc + j] = acc;
+        }
+}
+void _sysy_matmul_f32(int m, int n, int k, const float *a, int lda, const float *b, int ldb,
+                      float *c, int ldc, int accumulate) {
+    if (!accumulate)
+        for (int i = 0; i < m; i++)
+            for (int j = 0; j < n; j++)
+                c[i * ldc + j] = 0;
+    for (int j0 = 0; j0 < n; j0 += _SYSY_MM_NB) {
+        int j1 = n - j0 < _SYSY_MM_NB ? n : j0 + _SYSY_MM_NB;
+        for (int p0 = 0; p0 < k; p0 += _SYSY_MM_KB) {
+            int p1 = k - p0 < _SYSY_MM_KB ? k : p0 + _SYSY_MM_KB;
+            int i = 0;
+            for (; i + 4 <= m; i += 4) {
+                int j = j0;
+                for (; j + 4 <= j1; j += 4)
+                    _sysy_mm_tile_f32(p0, p1, a + i * lda, lda, b + j, ldb, c + i * ldc + j, ldc);
+                _sysy_mm_edge_f32(4, j1 - j, p0, p1, a + i * lda, lda, b + j, ldb, c + i * ldc + j, ldc);
+            }
+            _sysy_mm_edge_f32(m - i, j1 - j0, p0, p1, a + i * lda, lda, b + j0, ldb, c + i * ldc + j0, ldc);
+        }
+    }
+}
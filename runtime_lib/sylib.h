@@ -28,4 +28,17 @@ __attribute((destructor)) void after_main();
 void _sysy_starttime(int lineno);
 void _sysy_stoptime(int lineno);
 
+/* Fork-join thread pool for loops parallelized by the compiler */
+#define _SYSY_MAX_THREADS 4
+typedef void (*_sysy_loop_body)(int begin, int end, void *ctx, int thread);
+void _sysy_parallel_for(_sysy_loop_body body, int begin, int end, void *ctx);
+
+/* Matrix multiply kernels for loop nests recognized by the compiler:
+   C[i][j] = (accumulate ? C[i][j] : 0) + sum(A[i][p] * B[p][j]) for p = 0..k-1,
+   row-major with leading dimensions lda/ldb/ldc; the products are added in increasing p */
+void _sysy_matmul_i32(int m, int n, int k, const int *a, int lda, const int *b, int ldb,
+                      int *c, int ldc, int accumulate);
+void _sysy_matmul_f32(int m, int n, int k, const float *a, int lda, const float *b, int ldb,
+                      float *c, int ldc, int accumulate);
+
 #endif
@@ -452,7 +452,7 @@ llvm::Value *AST::UnaryExpr::codeGen() {
             auto [valueFix, newType] =
                     unaryExprTypeFix(value, Typename::INT, Typename::FLOAT);
             if (newType == Typename::INT) {
-                return IR::ctx.builder.CreateNeg(valueFix);
+                return IR::ctx.builder.CreateNSWNeg(valueFix);
             }
             if (newType == Typename::FLOAT) {
                 return IR::ctx.builder.CreateFNeg(valueFix);
@@ -513,13 +513,14 @@ llvm::Value *AST::BinaryExpr::codeGen() {
     switch (op) {
 
         // 算数运算
+        // 与C语言相同，有符号整数溢出是未定义行为，整数加减乘均带nsw标记，便于归纳变量分析和向量化
         case Operator::ADD: {
             llvm::Value *L = lhs->codeGen();
             llvm::Value *R = rhs->codeGen();
             auto [LFix, RFix, nodeType] =
                     binaryExprTypeFix(L, R, Typename::INT, Typename::FLOAT);
             if (nodeType == Typename::INT) {
-                return IR::ctx.builder.CreateAdd(LFix, RFix);
+                return IR::ctx.builder.CreateNSWAdd(LFix, RFix);
             }
             if (nodeType == Typename::FLOAT) {
                 return IR::ctx.builder.CreateFAdd(LFix, RFix);
@@ -531,7 +532,7 @@ llvm::Value *AST::BinaryExpr::codeGen() {
             auto [LFix, RFix, nodeType] =
                     binaryExprTypeFix(L, R, Typename::INT, Typename::FLOAT);
             if (nodeType == Typename::INT) {
-                return IR::ctx.builder.CreateSub(LFix, RFix);
+                return IR::ctx.builder.CreateNSWSub(LFix, RFix);
             }
             if (nodeType == Typename::FLOAT) {
                 return IR::ctx.builder.CreateFSub(LFix, RFix);
@@ -543,7 +544,7 @@ llvm::Value *AST::BinaryExpr::codeGen() {
             auto [LFix, RFix, nodeType] =
                     binaryExprTypeFix(L, R, Typename::INT, Typename::FLOAT);
             if (nodeType == Typename::INT) {
-                return IR::ctx.builder.CreateMul(LFix, RFix);
+                return IR::ctx.builder.CreateNSWMul(LFix, RFix);
             }
             if (nodeType == Typename::FLOAT) {
                 return IR::ctx.builder.CreateFMul(LFix, RFix);
@@ -786,7 +787,7 @@ llvm::Value *AST::VariableExpr::codeGen() {
     // 数组使用指针传参
     // 普遍变量使用值传参
     if (var->getType()->getPointerElementType()->isArrayTy()) {
-        return IR::ctx.builder.CreateGEP(
+        return IR::ctx.builder.CreateInBoundsGEP(
                 var->getType()->getPointerElementType(),
                 var,
                 {
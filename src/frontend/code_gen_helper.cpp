@@ -167,7 +167,8 @@ CodeGenHelper::dynamicInitValCodeGen(
 ) {
     if (std::holds_alternative<AST::Expr *>(initializerElement->element)) {
         auto val = std::get<AST::Expr *>(initializerElement->element)->codeGen();
-        auto var = IR::ctx.builder.CreateGEP(
+        // 普通变量直接存储，不生成GEP，以免阻碍mem2reg提升
+        auto var = indices.empty() ? alloca : IR::ctx.builder.CreateInBoundsGEP(
                 alloca->getType()->getPointerElementType(),
                 alloca,
                 getGEPIndices(indices)
@@ -217,13 +218,13 @@ CodeGenHelper::getVariablePointer(
                     var->getType()->getPointerElementType(),
                     var
             );
-            var = IR::ctx.builder.CreateGEP(
+            var = IR::ctx.builder.CreateInBoundsGEP(
                     var->getType()->getPointerElementType(),
                     var,
                     index
             );
         } else {
-            var = IR::ctx.builder.CreateGEP(
+            var = IR::ctx.builder.CreateInBoundsGEP(
                     var->getType()->getPointerElementType(),
                     var,
                     {
@@ -218,6 +218,7 @@ void AST::UnaryExpr::constEval(AST::Base *&root) {
 
 void AST::FunctionCallExpr::constEval(AST::Base *&root) {
     // 什么也不做
+    // 实参为常量的纯函数调用在优化时由ConstCallEvalPass在IR上求值
 }
 
 static std::tuple<std::variant<int, float>, std::variant<int, float>, Typename>
@@ -4,6 +4,25 @@
 #include "IR.h"
 #include "lib.h"
 
+// 运行时库函数只通过标准输入输出（IR不可见的内存）与外界交互，不会读写用户的全局变量
+// 带数组参数的函数还会访问参数指向的数组，但不会保存该指针
+static void addRuntimeAttributes(llvm::Function *func) {
+    bool hasArrayArg = false;
+    for (auto &arg: func->args()) {
+        if (arg.getType()->isPointerTy()) {
+            arg.addAttr(llvm::Attribute::NoCapture);
+            hasArrayArg = true;
+        }
+    }
+    func->addFnAttr(hasArrayArg ?
+                    llvm::Attribute::InaccessibleMemOrArgMemOnly :
+                    llvm::Attribute::InaccessibleMemOnly);
+    func->addFnAttr(llvm::Attribute::NoUnwind);
+    func->addFnAttr(llvm::Attribute::WillReturn);
+    func->addFnAttr(llvm::Attribute::NoFree);
+    func->addFnAttr(llvm::Attribute::NoSync);
+}
+
 // int getint()
 static void addGetintPrototype() {
     std::vector<llvm::Type *> argTypes;
@@ -12,12 +31,13 @@ static void addGetintPrototype() {
             argTypes,
             false
     );
-    llvm::Function::Create(
+    llvm::Function *func = llvm::Function::Create(
             funcType,
             llvm::Function::ExternalLinkage,
             "getint",
             IR::ctx.module
     );
+    addRuntimeAttributes(func);
 }
 
 // int getch()
@@ -28,12 +48,13 @@ static void addGetchPrototype() {
             argTypes,
             false
     );
-    llvm::Function::Create(
+    llvm::Function *func = llvm::Function::Create(
             funcType,
             llvm::Function::ExternalLinkage,
             "getch",
             IR::ctx.module
     );
+    addRuntimeAttributes(func);
 }
 
 // int getarray(int a[])
@@ -53,6 +74,8 @@ static void addGetarrayPrototype() {
             IR::ctx.module
     );
     func->getArg(0)->setName("a");
+    func->getArg(0)->addAttr(llvm::Attribute::WriteOnly);
+    addRuntimeAttributes(func);
 }
 
 // float getfloat()
@@ -63,12 +86,13 @@ static void addGetfloatPrototype() {
             argTypes,
             false
     );
-    llvm::Function::Create(
+    llvm::Function *func = llvm::Function::Create(
             funcType,
             llvm::Function::ExternalLinkage,
             "getfloat",
             IR::ctx.module
     );
+    addRuntimeAttributes(func);
 }
 
 // int getfarray(float a[])
@@ -88,6 +112,8 @@ static void addGetfarrayPrototype() {
             IR::ctx.module
     );
     func->getArg(0)->setName("a");
+    func->getArg(0)->addAttr(llvm::Attribute::WriteOnly);
+    addRuntimeAttributes(func);
 }
 
 // void putint(int a)
@@ -107,6 +133,7 @@ static void addPutintPrototype() {
             IR::ctx.module
     );
     func->getArg(0)->setName("a");
+    addRuntimeAttributes(func);
 }
 
 // void putch(int a)
@@ -126,6 +153,7 @@ static void addPutchPrototype() {
             IR::ctx.module
     );
     func->getArg(0)->setName("a");
+    addRuntimeAttributes(func);
 }
 
 // void putarray(int n, int a[])
@@ -147,6 +175,8 @@ static void addPutarrayPrototype() {
     );
     func->getArg(0)->setName("n");
     func->getArg(1)->setName("a");
+    func->getArg(1)->addAttr(llvm::Attribute::ReadOnly);
+    addRuntimeAttributes(func);
 }
 
 // void putfloat(float a)
@@ -166,6 +196,7 @@ static void addPutfloatPrototype() {
             IR::ctx.module
     );
     func->getArg(0)->setName("a");
+    addRuntimeAttributes(func);
 }
 
 // void putfarray(int n, float a[])
@@ -187,6 +218,8 @@ static void addPutfarrayPrototype() {
     );
     func->getArg(0)->setName("n");
     func->getArg(1)->setName("a");
+    func->getArg(1)->addAttr(llvm::Attribute::ReadOnly);
+    addRuntimeAttributes(func);
 }
 
 // void _sysy_starttime(int lineno)
@@ -206,6 +239,7 @@ static void addSysyStarttimePrototype() {
             IR::ctx.module
     );
     func->getArg(0)->setName("lineno");
+    addRuntimeAttributes(func);
 }
 
 // void _sysy_stoptime(int lineno)
@@ -225,6 +259,7 @@ static void addSysyStoptimePrototype() {
             IR::ctx.module
     );
     func->getArg(0)->setName("lineno");
+    addRuntimeAttributes(func);
 }
 
 void addLibraryPrototype() {
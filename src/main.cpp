@@ -1,7 +1,9 @@
 #include <iostream>
-#include <tuple>
 #include <string>
 #include <cstdio>
+#include <stdexcept>
+#include <vector>
+#include <llvm/Support/CommandLine.h>
 #include "AST.h"
 #include "log.h"
 #include "parser.h"
@@ -14,19 +16,61 @@
 // compiler -S -o testcase.s testcase.sy
 // compiler -S -o testcase.s testcase.sy -O2
 // [0]      [1][2][3]        [4]         [5]
+// 之后可以附加目标平台选项（顺序任意）：
+// -march=armv7-a -mcpu=cortex-a72 -mfpu=neon-vfpv4 -mfloat-abi=hard
+// 以及优化备注选项：-Rpass=<正则> -Rpass-missed=<正则> -Rpass-analysis=<正则>
+// 以及传给LLVM的内部选项：-mllvm <选项>，例如 -mllvm -auto-parallel
 
-static std::tuple<std::string, std::string, int>
-cmdParse(int argc, char *argv[]) {
-    if (argc != 5 && argc != 6) {
+struct CmdOptions {
+    std::string inputFilename;
+    std::string outputFilename;
+    int optLevel = 0;
+    TargetOptions targetOptions;
+    RemarkOptions remarkOptions;
+    std::vector<std::string> llvmOptions;
+};
+
+static CmdOptions cmdParse(int argc, char *argv[]) {
+    if (argc < 5) {
         throw std::runtime_error("invalid command params");
     }
 
-    // 获得优化级别
-    int optLevel = 0;
-    if (argc == 6 && std::string_view(argv[5]) == "-O2") {
-        optLevel = 2;
+    CmdOptions options;
+    options.outputFilename = argv[3];
+    options.inputFilename = argv[4];
+
+    // 获得优化级别和目标平台选项
+    for (int i = 5; i < argc; i++) {
+        std::string_view arg(argv[i]);
+        auto value = [&](std::string_view prefix) {
+            return std::string(arg.substr(prefix.size()));
+        };
+        if (arg == "-O2") {
+            options.optLevel = 2;
+        } else if (arg.rfind("-O", 0) == 0) {
+            // 其他优化级别按不开启优化处理
+            options.optLevel = 0;
+        } else if (arg.rfind("-march=", 0) == 0) {
+            options.targetOptions.arch = value("-march=");
+        } else if (arg.rfind("-mcpu=", 0) == 0) {
+            options.targetOptions.cpu = value("-mcpu=");
+        } else if (arg.rfind("-mfpu=", 0) == 0) {
+            options.targetOptions.fpu = value("-mfpu=");
+        } else if (arg.rfind("-mfloat-abi=", 0) == 0) {
+            options.targetOptions.floatABI = value("-mfloat-abi=");
+        } else if (arg == "-mllvm" && i + 1 < argc) {
+            options.llvmOptions.emplace_back(argv[++i]);
+        } else if (arg.rfind("-Rpass=", 0) == 0) {
+            options.remarkOptions.passed = value("-Rpass=");
+        } else if (arg.rfind("-Rpass-missed=", 0) == 0) {
+            options.remarkOptions.missed = value("-Rpass-missed=");
+        } else if (arg.rfind("-Rpass-analysis=", 0) == 0) {
+            options.remarkOptions.analysis = value("-Rpass-analysis=");
+        } else {
+            throw std::runtime_error("invalid command param: " + std::string(arg));
+        }
     }
-    return {argv[4], argv[3], optLevel};
+    return options;
 }
 
 int main(int argc, char *argv[]) {
@@ -41,12 +85,23 @@ int main(int argc, char *argv[]) {
         });
 
         // 解析命令行参数
-        auto [inputFilename, outputFilename, optLevel] = cmdParse(argc, argv);
+        CmdOptions options = cmdParse(argc, argv);
+
+        // 解析-mllvm传入的LLVM内部选项（cl::opt）
+        // SysY中数组下标越界是未定义行为，多维数组每一维的下标都在该维的范围内，
+        // 依赖分析可以直接按数组的维度拆分下标，不必先证明下标不越界
+        std::vector<const char *> llvmArgv{argv[0], "-da-disable-delinearization-checks"};
+        for (const std::string &option: options.llvmOptions) {
+            llvmArgv.push_back(option.c_str());
+        }
+        if (!llvm::cl::ParseCommandLineOptions(llvmArgv.size(), llvmArgv.data(), "", &llvm::errs())) {
+            throw std::invalid_argument("invalid -mllvm option");
+        }
 
         // 输入重定向
-        if (auto fd = freopen(inputFilename.c_str(), "r", stdin);
+        if (auto fd = freopen(options.inputFilename.c_str(), "r", stdin);
                 fd == nullptr) {
-            throw std::runtime_error("failed to open file: " + inputFilename);
+            throw std::runtime_error("failed to open file: " + options.inputFilename);
         }
 
         // 生成AST
@@ -67,8 +122,12 @@ int main(int argc, char *argv[]) {
         IR::show();
 
         // 生成汇编代码
-        PassManager::run(optLevel, outputFilename);
+        PassManager::run(options.optLevel, options.outputFilename,
+                         options.targetOptions, options.remarkOptions);
 
+    } catch (std::invalid_argument &e) {
+        err("main") << "invalid option: " << e.what() << std::endl;
+        return 1;
     } catch (std::runtime_error &e) {
         err("main") << "invalid source file: " << e.what() << std::endl;
         return 1;
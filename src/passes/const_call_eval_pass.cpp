@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CommandLine.h>
+#include "log.h"
+#include "ir_interpreter.h"
+#include "const_call_eval_pass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "const-call-eval"
+
+STATISTIC(NumEvaluated, "Number of calls evaluated at compile time");
+
+static cl::opt<unsigned> CallFuel(
+        "const-call-eval-fuel", cl::init(1000000), cl::Hidden,
+        cl::desc("Max IR instructions interpreted to evaluate one call"));
+
+// 整个模块用于编译期求值的步数上限，控制编译时间
+static cl::opt<unsigned> ModuleFuel(
+        "const-call-eval-module-fuel", cl::init(20000000), cl::Hidden,
+        cl::desc("Max IR instructions interpreted for all calls in a module"));
+
+// 被调函数（包括递归调用的每一层）的局部数组在解释器中分配的内存
+static cl::opt<unsigned> CallMemoryLimit(
+        "const-call-eval-memory-limit", cl::init(16 << 20), cl::Hidden,
+        cl::desc("Max bytes of local arrays allocated to evaluate one call"));
+
+// 实参全部为标量常量、结果为标量或void的直接调用
+static bool isCandidate(const CallInst &CI) {
+    Function *callee = CI.getCalledFunction();
+    if (!callee || callee->isDeclaration() || callee->isVarArg()) {
+        return false;
+    }
+    Type *type = CI.getType();
+    if (!type->isVoidTy() && !type->isIntegerTy(32) && !type->isFloatTy()) {
+        return false;
+    }
+    return std::all_of(CI.arg_begin(), CI.arg_end(), [](const Use &arg) {
+        return isa<ConstantInt>(arg.get()) || isa<ConstantFP>(arg.get());
+    });
+}
+
+PreservedAnalyses ConstCallEvalPass::run(Module &M, ModuleAnalysisManager &AM) {
+    SmallVector<CallInst *, 16> calls;
+    for (Function &F: M) {
+        for (Instruction &I: instructions(F)) {
+            auto *CI = dyn_cast<CallInst>(&I);
+            if (CI && isCandidate(*CI)) {
+                calls.push_back(CI);
+            }
+        }
+    }
+
+    uint64_t remainingFuel = ModuleFuel;
+    bool changed = false;
+    for (CallInst *CI: calls) {
+        if (remainingFuel == 0) {
+            break;
+        }
+        uint64_t fuel = std::min<uint64_t>(CallFuel, remainingFuel);
+        IRInterpreter interpreter(M.getDataLayout(), fuel, CallMemoryLimit);
+
+        SmallVector<IRInterpreter::Value, 4> args;
+        for (const Use &arg: CI->args()) {
+            args.emplace_back();
+            interpreter.getConstantValue(cast<Constant>(arg.get()), args.back());
+        }
+
+        IRInterpreter::Value result;
+        bool success = interpreter.call(*CI->getCalledFunction(), args, result);
+        remainingFuel -= fuel - interpreter.getRemainingFuel();
+        if (!success) {
+            continue;
+        }
+
+        log("const call") << CI->getFunction()->getName().str() << ": "
+                          << CI->getCalledFunction()->getName().str() << " evaluated in "
+                          << fuel - interpreter.getRemainingFuel() << " steps" << std::endl;
+        if (!CI->getType()->isVoidTy()) {
+            CI->replaceAllUsesWith(IRInterpreter::toConstant(result, CI->getType()));
+        }
+        CI->eraseFromParent();
+        NumEvaluated++;
+        changed = true;
+    }
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
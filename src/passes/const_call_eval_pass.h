@@ -0,0 +1,13 @@
+#ifndef SYSY_COMPILER_PASSES_CONST_CALL_EVAL_PASS_H
+#define SYSY_COMPILER_PASSES_CONST_CALL_EVAL_PASS_H
+
+#include <llvm/IR/PassManager.h>
+
+// 编译期求值：实参全部为常量的函数调用，若被调函数只读写自己的局部变量和常量全局变量、
+// 不调用运行时库，且能在步数限制内执行完毕，则用IR解释器求出返回值并替换调用
+class ConstCallEvalPass : public llvm::PassInfoMixin<ConstCallEvalPass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+};
+
+#endif //SYSY_COMPILER_PASSES_CONST_CALL_EVAL_PASS_H
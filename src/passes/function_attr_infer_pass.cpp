@@ -0,0 +1,218 @@
+#include <llvm/ADT/SCCIterator.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/CFG.h>
+#include <llvm/Analysis/CallGraph.h>
+#include <llvm/Analysis/CaptureTracking.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Module.h>
+#include "log.h"
+#include "function_attr_infer_pass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "function-attr-infer"
+
+STATISTIC(NumReadNone, "Number of functions marked readnone");
+STATISTIC(NumReadOnly, "Number of functions marked readonly");
+STATISTIC(NumArgMemOnly, "Number of functions marked argmemonly");
+STATISTIC(NumWillReturn, "Number of functions marked willreturn");
+STATISTIC(NumNoRecurse, "Number of functions marked norecurse");
+STATISTIC(NumNoCapture, "Number of arguments marked nocapture");
+
+namespace {
+
+    // 一个SCC中所有函数的内存访问情况的并集
+    // 函数自己的局部变量（alloca）不可被外界观察，不计入
+    struct MemoryEffects {
+        bool mayRead = false;
+        bool mayWrite = false;
+        bool accessArg = false;
+        bool accessInaccessible = false;
+        bool accessOther = false;
+
+        // 记录通过ptr进行的一次读/写
+        void addAccess(const Value *ptr, bool read, bool write) {
+            SmallVector<const Value *, 4> objects;
+            getUnderlyingObjects(ptr, objects, nullptr, 0);
+
+            bool local = true;
+            for (const Value *obj: objects) {
+                if (isa<AllocaInst>(obj)) {
+                    continue;
+                }
+                local = false;
+                if (isa<Argument>(obj)) {
+                    accessArg = true;
+                } else {
+                    accessOther = true;
+                }
+            }
+
+            if (!local) {
+                mayRead |= read;
+                mayWrite |= write;
+            }
+        }
+
+        // 根据被调函数的属性记录调用的访存情况
+        void addCall(const CallBase *CB) {
+            if (CB->doesNotAccessMemory()) {
+                return;
+            }
+            bool read = !CB->onlyWritesMemory();
+            bool write = !CB->onlyReadsMemory();
+
+            if (CB->onlyAccessesInaccessibleMemory()) {
+                accessInaccessible = true;
+                mayRead |= read;
+                mayWrite |= write;
+            } else if (CB->onlyAccessesArgMemory() || CB->onlyAccessesInaccessibleMemOrArgMem()) {
+                if (CB->onlyAccessesInaccessibleMemOrArgMem()) {
+                    accessInaccessible = true;
+                    mayRead |= read;
+                    mayWrite |= write;
+                }
+                for (unsigned i = 0; i < CB->arg_size(); i++) {
+                    const Value *arg = CB->getArgOperand(i);
+                    if (arg->getType()->isPointerTy() && !CB->doesNotAccessMemory(i)) {
+                        addAccess(arg, read, write && !CB->onlyReadsMemory(i));
+                    }
+                }
+            } else {
+                accessOther = true;
+                mayRead |= read;
+                mayWrite |= write;
+            }
+        }
+    };
+
+}
+
+// 清除函数上已有的内存访问属性，重新设置
+static void setMemoryAttributes(Function &F, const MemoryEffects &effects) {
+    for (auto kind: {Attribute::ReadNone, Attribute::ReadOnly, Attribute::WriteOnly,
+                     Attribute::ArgMemOnly, Attribute::InaccessibleMemOnly,
+                     Attribute::InaccessibleMemOrArgMemOnly}) {
+        F.removeFnAttr(kind);
+    }
+
+    if (!effects.mayRead && !effects.mayWrite) {
+        F.addFnAttr(Attribute::ReadNone);
+        ++NumReadNone;
+        return;
+    }
+    if (!effects.mayWrite) {
+        F.addFnAttr(Attribute::ReadOnly);
+        ++NumReadOnly;
+    }
+    if (!effects.accessOther) {
+        if (!effects.accessInaccessible) {
+            F.addFnAttr(Attribute::ArgMemOnly);
+            ++NumArgMemOnly;
+        } else if (effects.accessArg) {
+            F.addFnAttr(Attribute::InaccessibleMemOrArgMemOnly);
+        } else {
+            F.addFnAttr(Attribute::InaccessibleMemOnly);
+        }
+    }
+}
+
+// 没有循环的函数一定会返回（被调函数也都会返回的前提下）
+static bool isAcyclic(const Function &F) {
+    SmallVector<std::pair<const BasicBlock *, const BasicBlock *>, 8> backEdges;
+    FindFunctionBackedges(F, backEdges);
+    return backEdges.empty();
+}
+
+PreservedAnalyses FunctionAttrInferPass::run(Module &M, ModuleAnalysisManager &AM) {
+    CallGraph CG(M);
+
+    // scc_iterator按照后序遍历，被调函数所在的SCC先于调用者处理
+    for (auto it = scc_begin(&CG); !it.isAtEnd(); ++it) {
+        SmallPtrSet<Function *, 4> scc;
+        for (CallGraphNode *node: *it) {
+            Function *F = node->getFunction();
+            if (F && !F->isDeclaration()) {
+                scc.insert(F);
+            }
+        }
+        if (scc.empty()) {
+            continue;
+        }
+
+        // SysY没有函数指针，调用图是精确的
+        bool recursive = it.hasCycle();
+        bool willReturn = !recursive;
+        // SysY没有异常，自身也不会释放内存或进行同步，nofree和nosync只取决于被调函数
+        bool noFree = true;
+        bool noSync = true;
+        MemoryEffects effects;
+        for (Function *F: scc) {
+            willReturn = willReturn && isAcyclic(*F);
+            for (Instruction &I: instructions(*F)) {
+                if (auto *CB = dyn_cast<CallBase>(&I)) {
+                    Function *callee = CB->getCalledFunction();
+                    if (callee && scc.count(callee)) {
+                        continue;
+                    }
+                    willReturn = willReturn && CB->hasFnAttr(Attribute::WillReturn);
+                    noFree = noFree && CB->hasFnAttr(Attribute::NoFree);
+                    // 非volatile的memset/memcpy（记忆化的表和数组的初始化）不进行同步，但没有nosync属性
+                    auto *MI = dyn_cast<MemIntrinsic>(CB);
+                    noSync = noSync && (CB->hasFnAttr(Attribute::NoSync) || (MI && !MI->isVolatile()));
+                    effects.addCall(CB);
+                } else if (auto *LI = dyn_cast<LoadInst>(&I)) {
+                    effects.addAccess(LI->getPointerOperand(), true, false);
+                } else if (auto *SI = dyn_cast<StoreInst>(&I)) {
+                    effects.addAccess(SI->getPointerOperand(), false, true);
+                } else if (I.mayReadOrWriteMemory()) {
+                    effects.accessOther = true;
+                    effects.mayRead |= I.mayReadFromMemory();
+                    effects.mayWrite |= I.mayWriteToMemory();
+                }
+            }
+        }
+
+        for (Function *F: scc) {
+            setMemoryAttributes(*F, effects);
+
+            F->addFnAttr(Attribute::NoUnwind);
+            if (noFree) {
+                F->addFnAttr(Attribute::NoFree);
+            }
+            if (noSync) {
+                F->addFnAttr(Attribute::NoSync);
+            }
+
+            if (willReturn && !F->hasFnAttribute(Attribute::WillReturn)) {
+                F->addFnAttr(Attribute::WillReturn);
+                ++NumWillReturn;
+            }
+            if (!recursive && !F->doesNotRecurse()) {
+                F->setDoesNotRecurse();
+                ++NumNoRecurse;
+            }
+
+            // SysY中无法保存指针，数组参数只会被用于访问元素或继续传参
+            // 由于被调函数先处理，继续传参的情况也能借助被调函数的nocapture判定
+            for (Argument &arg: F->args()) {
+                if (arg.getType()->isPointerTy() && !arg.hasNoCaptureAttr() &&
+                    !PointerMayBeCaptured(&arg, true, true)) {
+                    arg.addAttr(Attribute::NoCapture);
+                    ++NumNoCapture;
+                }
+            }
+
+            log("func attr") << F->getName().str() << ": "
+                             << F->getAttributes().getFnAttrs().getAsString() << std::endl;
+        }
+    }
+
+    // 属性变化会影响函数级的别名查询结果，因此不保留任何分析
+    return PreservedAnalyses::none();
+}
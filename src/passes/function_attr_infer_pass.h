@@ -0,0 +1,13 @@
+#ifndef SYSY_COMPILER_PASSES_FUNCTION_ATTR_INFER_PASS_H
+#define SYSY_COMPILER_PASSES_FUNCTION_ATTR_INFER_PASS_H
+
+#include <llvm/IR/PassManager.h>
+
+// 沿调用图自底向上推导函数属性：
+// readnone/readonly/argmemonly、nounwind、nofree、nosync、willreturn、norecurse以及参数的nocapture
+class FunctionAttrInferPass : public llvm::PassInfoMixin<FunctionAttrInferPass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+};
+
+#endif //SYSY_COMPILER_PASSES_FUNCTION_ATTR_INFER_PASS_H
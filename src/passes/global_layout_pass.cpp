@@ -0,0 +1,248 @@
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/IR/ReplaceConstant.h>
+#include <llvm/Support/CommandLine.h>
+#include "log.h"
+#include "global_layout_pass.h"
+#include "target_machine.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "global-layout"
+
+STATISTIC(NumAligned, "Number of global arrays aligned to a cache line");
+STATISTIC(NumPadded, "Number of global arrays with padded rows");
+
+// 为0时使用-mcpu=所选CPU的cache行大小
+static cl::opt<unsigned> CacheLine(
+        "global-layout-cache-line", cl::init(0), cl::Hidden,
+        cl::desc("Cache line size used for global layout (0 uses the target CPU's)"));
+
+static cl::opt<unsigned> AlignMinSize(
+        "global-layout-align-min-size", cl::init(256), cl::Hidden,
+        cl::desc("Min size in bytes of a global array aligned to a cache line"));
+
+// 行大小为2的幂且不小于它时，按列遍历只用到L1 cache中很少的几组
+static cl::opt<unsigned> PadMinRowSize(
+        "global-layout-pad-min-row-size", cl::init(512), cl::Hidden,
+        cl::desc("Min row size in bytes of a global array to pad"));
+
+// 能放进L1 cache的数组不会因冲突被反复换出，为0时使用-mcpu=所选CPU的L1数据cache容量
+static cl::opt<unsigned> PadMinSize(
+        "global-layout-pad-min-size", cl::init(0), cl::Hidden,
+        cl::desc("Min size in bytes of a global array to pad (0 uses the target CPU's L1 cache size)"));
+
+// 收集经由（可能嵌套的）常量表达式使用C的所有指令
+static void collectInstructionUsers(Constant *C, SmallPtrSetImpl<Instruction *> &insts) {
+    for (User *U: C->users()) {
+        if (auto *I = dyn_cast<Instruction>(U)) {
+            insts.insert(I);
+        } else if (auto *CE = dyn_cast<ConstantExpr>(U)) {
+            collectInstructionUsers(CE, insts);
+        }
+    }
+}
+
+// 指向二维数组或其中一行的指针V只被用于下标访问：GEP得到的行指针同样如此，
+// 元素指针只被load/store用作地址，不传给函数、不转换类型，因此行的大小可以改变
+static bool hasOnlyIndexedUses(Value *V, ArrayType *arrayType) {
+    auto *rowType = cast<ArrayType>(arrayType->getElementType());
+    for (User *U: V->users()) {
+        auto *GEP = dyn_cast<GEPOperator>(U);
+        if (!GEP || GEP->getPointerOperand() != V) {
+            return false;
+        }
+        Type *result = GEP->getResultElementType();
+        if (result == arrayType || result == rowType) {
+            if (!hasOnlyIndexedUses(GEP, arrayType)) {
+                return false;
+            }
+        } else if (result != rowType->getElementType() || any_of(GEP->users(), [&](User *elementUser) {
+            return getLoadStorePointerOperand(elementUser) != GEP;
+        })) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 把旧数组上的GEP改写为新数组上下标相同的GEP
+static void rewriteIndexedUses(Value *oldV, Value *newV, ArrayType *arrayType, ArrayType *newArrayType) {
+    for (User *U: make_early_inc_range(oldV->users())) {
+        auto *GEP = cast<GetElementPtrInst>(U);
+        Type *source = GEP->getSourceElementType() == arrayType ? newArrayType : newArrayType->getElementType();
+        SmallVector<Value *, 4> indices(GEP->indices());
+        auto *newGEP = GetElementPtrInst::Create(source, newV, indices, "", GEP);
+        newGEP->setIsInBounds(GEP->isInBounds());
+        newGEP->takeName(GEP);
+        if (newGEP->getType() == GEP->getType()) {
+            GEP->replaceAllUsesWith(newGEP);
+        } else {
+            rewriteIndexedUses(GEP, newGEP, arrayType, newArrayType);
+        }
+        GEP->eraseFromParent();
+    }
+}
+
+// 每行末尾补0
+static Constant *padInitializer(Constant *init, ArrayType *newArrayType) {
+    if (init->isNullValue()) {
+        return Constant::getNullValue(newArrayType);
+    }
+    auto *newRowType = cast<ArrayType>(newArrayType->getElementType());
+    auto *oldRowType = cast<ArrayType>(init->getType()->getArrayElementType());
+    SmallVector<Constant *, 64> rows;
+    for (uint64_t i = 0; i < newArrayType->getNumElements(); i++) {
+        Constant *row = init->getAggregateElement(i);
+        SmallVector<Constant *, 64> elements;
+        for (uint64_t j = 0; j < oldRowType->getNumElements(); j++) {
+            elements.push_back(row->getAggregateElement(j));
+        }
+        elements.resize(newRowType->getNumElements(), Constant::getNullValue(newRowType->getElementType()));
+        rows.push_back(ConstantArray::get(newRowType, elements));
+    }
+    return ConstantArray::get(newArrayType, rows);
+}
+
+// 行大小为2的幂的二维大数组，所有使用都是下标访问时每行补一个cache行，返回新的全局变量
+static GlobalVariable *padRows(GlobalVariable *GV, const CPUCacheInfo &cache) {
+    const DataLayout &DL = GV->getParent()->getDataLayout();
+    auto *arrayType = dyn_cast<ArrayType>(GV->getValueType());
+    auto *rowType = arrayType ? dyn_cast<ArrayType>(arrayType->getElementType()) : nullptr;
+    if (!rowType || rowType->getElementType()->isArrayTy() || !GV->hasInitializer()) {
+        return nullptr;
+    }
+    uint64_t elementSize = DL.getTypeAllocSize(rowType->getElementType());
+    uint64_t rowSize = DL.getTypeAllocSize(rowType);
+    if (!isPowerOf2_64(rowSize) || rowSize < PadMinRowSize || DL.getTypeAllocSize(arrayType) < (PadMinSize ? PadMinSize : cache.L1Size) ||
+        cache.lineSize % elementSize || !hasOnlyIndexedUses(GV, arrayType)) {
+        return nullptr;
+    }
+
+    // 将常量表达式形式的使用（例如常量下标的GEP）展开为指令，之后统一改写
+    SmallVector<ConstantExpr *, 4> constantUsers;
+    for (User *U: GV->users()) {
+        if (auto *CE = dyn_cast<ConstantExpr>(U)) {
+            constantUsers.push_back(CE);
+        }
+    }
+    for (ConstantExpr *CE: constantUsers) {
+        SmallPtrSet<Instruction *, 8> instUsers;
+        collectInstructionUsers(CE, instUsers);
+        for (Instruction *I: instUsers) {
+            convertConstantExprsToInstructions(I, CE);
+        }
+    }
+    GV->removeDeadConstantUsers();
+
+    auto *newRowType = ArrayType::get(rowType->getElementType(), rowType->getNumElements() + cache.lineSize / elementSize);
+    auto *newArrayType = ArrayType::get(newRowType, arrayType->getNumElements());
+    auto *newGV = new GlobalVariable(*GV->getParent(), newArrayType, GV->isConstant(), GV->getLinkage(),
+                                     padInitializer(GV->getInitializer(), newArrayType), "", GV);
+    newGV->takeName(GV);
+    newGV->setAlignment(GV->getAlign());
+    rewriteIndexedUses(GV, newGV, arrayType, newArrayType);
+    GV->eraseFromParent();
+    return newGV;
+}
+
+PreservedAnalyses GlobalLayoutPass::run(Module &M, ModuleAnalysisManager &AM) {
+    auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    const DataLayout &DL = M.getDataLayout();
+    CPUCacheInfo cache = getCPUCacheInfo(targetMachine);
+    if (CacheLine) {
+        cache.lineSize = CacheLine;
+    }
+    bool changed = false;
+
+    SmallVector<GlobalVariable *, 16> globals;
+    for (GlobalVariable &GV: make_early_inc_range(M.globals())) {
+        if (!GV.hasLocalLinkage() || !GV.hasInitializer()) {
+            continue;
+        }
+        GlobalVariable *padded = padRows(&GV, cache);
+        if (padded) {
+            log("global layout") << padded->getName().str() << " rows padded to "
+                                 << DL.getTypeAllocSize(padded->getValueType()->getArrayElementType()).getFixedSize()
+                                 << " bytes" << std::endl;
+            NumPadded++;
+            changed = true;
+        }
+        globals.push_back(padded ? padded : &GV);
+    }
+
+    // 对齐：大数组对齐到cache行，其余数组对齐到16字节供向量化的访问使用
+    for (GlobalVariable *GV: globals) {
+        if (!GV->getValueType()->isArrayTy()) {
+            continue;
+        }
+        uint64_t size = DL.getTypeAllocSize(GV->getValueType());
+        Align align(size >= AlignMinSize ? cache.lineSize : size >= 16 ? 16 : 1);
+        if (align > GV->getAlign().valueOrOne()) {
+            GV->setAlignment(align);
+            if (align.value() == cache.lineSize) {
+                NumAligned++;
+            }
+            changed = true;
+        }
+    }
+
+    // 使用频率：每处使用按所在循环的深度加权，每深一层乘8
+    DenseMap<GlobalVariable *, uint64_t> hotness;
+    for (GlobalVariable *GV: globals) {
+        SmallPtrSet<Instruction *, 16> users;
+        collectInstructionUsers(GV, users);
+        uint64_t weight = 0;
+        for (Instruction *I: users) {
+            auto &LI = FAM.getResult<LoopAnalysis>(*I->getFunction());
+            weight += uint64_t(1) << (3 * std::min(LI.getLoopDepth(I->getParent()), 6u));
+        }
+        hotness[GV] = weight;
+    }
+
+    // 排列：标量在前按频率从高到低，然后是小数组，大数组保持原来的顺序排在最后
+    auto category = [&](GlobalVariable *GV) {
+        if (!GV->getValueType()->isArrayTy()) {
+            return 0;
+        }
+        return DL.getTypeAllocSize(GV->getValueType()) < AlignMinSize ? 1 : 2;
+    };
+    SmallVector<GlobalVariable *, 16> order(globals);
+    std::stable_sort(order.begin(), order.end(), [&](GlobalVariable *a, GlobalVariable *b) {
+        int ca = category(a), cb = category(b);
+        if (ca != cb) {
+            return ca < cb;
+        }
+        return ca != 2 && hotness[a] > hotness[b];
+    });
+    if (order != globals) {
+        for (GlobalVariable *GV: order) {
+            GV->removeFromParent();
+            M.getGlobalList().push_back(GV);
+        }
+        changed = true;
+    }
+
+    // 初始化的和未初始化的全局变量分别在.data和.bss中，各自最频繁使用的标量对齐到cache行，
+    // 其后的标量与它共用同一cache行
+    bool alignedData = false, alignedBSS = false;
+    for (GlobalVariable *GV: order) {
+        if (category(GV) != 0 || GV->isConstant()) {
+            continue;
+        }
+        bool &aligned = GV->getInitializer()->isNullValue() ? alignedBSS : alignedData;
+        if (!aligned && hotness[GV]) {
+            GV->setAlignment(Align(cache.lineSize));
+            changed = true;
+        }
+        aligned = true;
+    }
+
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
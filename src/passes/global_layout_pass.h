@@ -0,0 +1,23 @@
+#ifndef SYSY_COMPILER_PASSES_GLOBAL_LAYOUT_PASS_H
+#define SYSY_COMPILER_PASSES_GLOBAL_LAYOUT_PASS_H
+
+#include <llvm/IR/PassManager.h>
+#include <llvm/Target/TargetMachine.h>
+
+// 全局数组的布局优化
+// 对齐：较大的数组对齐到cache行，向量化的访问可以假定16字节对齐，遍历时也不会多跨一个cache行
+// 填充：每行大小为2的幂的二维大数组（如int a[1024][1024]），按列遍历时各行的同一列映射到同一组cache，
+// 互相冲突；所有使用都是下标访问时每行末尾补一个cache行，使相邻行落在不同的组中
+// 排列：标量在前，按使用频率（循环中的使用按循环深度加权）排列，频繁使用的标量集中在同一cache行，
+// 第一个标量对齐到cache行，大数组排在最后，不与标量共用cache行
+// cache行大小和L1容量按-mcpu=选择的CPU查表
+class GlobalLayoutPass : public llvm::PassInfoMixin<GlobalLayoutPass> {
+    const llvm::TargetMachine &targetMachine;
+
+public:
+    explicit GlobalLayoutPass(const llvm::TargetMachine &targetMachine) : targetMachine(targetMachine) {}
+
+    llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+};
+
+#endif //SYSY_COMPILER_PASSES_GLOBAL_LAYOUT_PASS_H
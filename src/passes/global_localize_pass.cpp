@@ -0,0 +1,229 @@
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/CFG.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/ReplaceConstant.h>
+#include <llvm/Support/CommandLine.h>
+#include "log.h"
+#include "global_localize_pass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "global-localize"
+
+STATISTIC(NumLocalizedScalar, "Number of global scalars localized");
+STATISTIC(NumLocalizedArray, "Number of global arrays localized");
+
+// 数组放到栈上需要在函数入口处初始化，过大的数组留在.bss中
+static cl::opt<unsigned> ArrayLimit(
+        "global-localize-array-limit", cl::init(1024), cl::Hidden,
+        cl::desc("Max number of elements of a global array to localize"));
+
+// 初始化时逐个元素存储的数组大小上限，与mem2reg的数组拆分阈值保持一致，
+// 超过时先用memset清零，再存储非零元素
+static cl::opt<unsigned> ElementwiseInitLimit(
+        "global-localize-elementwise-init-limit", cl::init(64), cl::Hidden,
+        cl::desc("Max number of elements initialized by individual stores"));
+
+namespace {
+
+    // 判断函数在整个程序运行中是否最多执行一次：
+    // main没有被调用过；或者是只有一个调用点的内部函数，调用点所在函数最多执行一次，且调用点不在环路中
+    class ExecutedOnceInfo {
+        DenseMap<const Function *, bool> cache;
+
+    public:
+        bool isExecutedOnce(const Function *F) {
+            auto it = cache.find(F);
+            if (it != cache.end()) {
+                return it->second;
+            }
+            // 先假定为false，递归调用链上再次遇到时按保守处理
+            cache[F] = false;
+            bool result = compute(F);
+            cache[F] = result;
+            return result;
+        }
+
+    private:
+        bool compute(const Function *F) {
+            if (F->isDeclaration()) {
+                return false;
+            }
+            if (F->getName() == "main") {
+                return F->use_empty();
+            }
+            if (!F->hasLocalLinkage() || !F->hasOneUse()) {
+                return false;
+            }
+
+            auto *CB = dyn_cast<CallBase>(F->use_begin()->getUser());
+            if (!CB || !CB->isCallee(&*F->use_begin())) {
+                return false;
+            }
+            const Function *caller = CB->getFunction();
+            if (caller == F || !isExecutedOnce(caller)) {
+                return false;
+            }
+
+            // 调用点所在基本块能从自己的后继到达，说明处于循环中
+            auto *BB = const_cast<BasicBlock *>(CB->getParent());
+            SmallVector<BasicBlock *, 4> succs(successors(BB));
+            return succs.empty() || !isPotentiallyReachableFromMany(succs, BB, nullptr, nullptr, nullptr);
+        }
+    };
+
+} // namespace
+
+// 若全局变量的所有使用（包括经由常量表达式的间接使用）都在同一个函数中，返回该函数
+static Function *getOnlyUserFunction(const Constant *C, Function *F = nullptr) {
+    for (const User *U: C->users()) {
+        Function *userF;
+        if (auto *I = dyn_cast<Instruction>(U)) {
+            userF = const_cast<Function *>(I->getFunction());
+        } else if (auto *CE = dyn_cast<ConstantExpr>(U)) {
+            userF = getOnlyUserFunction(CE, F);
+            if (!userF) {
+                return nullptr;
+            }
+            // 常量表达式没有使用者时不限制所在函数
+            if (CE->use_empty()) {
+                continue;
+            }
+        } else {
+            return nullptr;
+        }
+        if (F && F != userF) {
+            return nullptr;
+        }
+        F = userF;
+    }
+    return F;
+}
+
+// 收集经由（可能嵌套的）常量表达式使用C的所有指令
+static void collectInstructionUsers(Constant *C, SmallPtrSetImpl<Instruction *> &insts) {
+    for (User *U: C->users()) {
+        if (auto *I = dyn_cast<Instruction>(U)) {
+            insts.insert(I);
+        } else if (auto *CE = dyn_cast<ConstantExpr>(U)) {
+            collectInstructionUsers(CE, insts);
+        }
+    }
+}
+
+// 获取类型中标量元素的个数，非数组类型视为1个
+static uint64_t getNumElements(Type *type) {
+    uint64_t n = 1;
+    while (auto *arrayType = dyn_cast<ArrayType>(type)) {
+        n *= arrayType->getNumElements();
+        type = arrayType->getElementType();
+    }
+    return n;
+}
+
+// 按初始值存储数组元素，skipZero为true时跳过值为0的元素
+static void storeInitializer(IRBuilder<> &builder, Value *ptr, Type *type,
+                             Constant *init, bool skipZero,
+                             SmallVectorImpl<Value *> &indices) {
+    if (skipZero && init->isNullValue()) {
+        return;
+    }
+    auto *arrayType = dyn_cast<ArrayType>(type);
+    if (!arrayType) {
+        Value *elementPtr = indices.size() == 1 ? ptr : builder.CreateInBoundsGEP(
+                ptr->getType()->getPointerElementType(), ptr, indices);
+        builder.CreateStore(init, elementPtr);
+        return;
+    }
+    for (uint64_t i = 0; i < arrayType->getNumElements(); i++) {
+        indices.push_back(builder.getInt32(i));
+        storeInitializer(builder, ptr, arrayType->getElementType(),
+                         init->getAggregateElement(i), skipZero, indices);
+        indices.pop_back();
+    }
+}
+
+// 在函数入口处创建局部变量并按全局变量的初始值初始化
+static AllocaInst *createLocal(GlobalVariable *GV, Function *F) {
+    Type *type = GV->getValueType();
+    BasicBlock &entry = F->getEntryBlock();
+    IRBuilder<> builder(&entry, entry.getFirstInsertionPt());
+    auto *alloca = builder.CreateAlloca(type, nullptr, GV->getName());
+    alloca->setAlignment(std::max(alloca->getAlign(), GV->getAlign().valueOrOne()));
+
+    // 初始化放在所有alloca之后，保证alloca集中在入口块开头
+    auto it = entry.begin();
+    while (isa<AllocaInst>(*it)) {
+        ++it;
+    }
+    builder.SetInsertPoint(&entry, it);
+
+    Constant *init = GV->getInitializer();
+    SmallVector<Value *, 4> indices{builder.getInt32(0)};
+    if (!type->isArrayTy() || getNumElements(type) <= ElementwiseInitLimit) {
+        storeInitializer(builder, alloca, type, init, false, indices);
+    } else {
+        const DataLayout &DL = F->getParent()->getDataLayout();
+        builder.CreateMemSet(alloca, builder.getInt8(0), DL.getTypeAllocSize(type), alloca->getAlign());
+        storeInitializer(builder, alloca, type, init, true, indices);
+    }
+    return alloca;
+}
+
+PreservedAnalyses GlobalLocalizePass::run(Module &M, ModuleAnalysisManager &AM) {
+    ExecutedOnceInfo executedOnce;
+    bool changed = false;
+
+    for (GlobalVariable &GV: llvm::make_early_inc_range(M.globals())) {
+        // 常量由常量折叠处理，不需要转换
+        if (GV.isConstant() || !GV.hasLocalLinkage() || !GV.hasInitializer()) {
+            continue;
+        }
+        Type *type = GV.getValueType();
+        if (type->isArrayTy() && getNumElements(type) > ArrayLimit) {
+            continue;
+        }
+
+        Function *F = getOnlyUserFunction(&GV);
+        if (!F || !executedOnce.isExecutedOnce(F)) {
+            continue;
+        }
+
+        // 将常量表达式形式的使用（例如常量下标的GEP）展开为指令，之后才能替换为alloca
+        SmallVector<ConstantExpr *, 4> constantUsers;
+        for (User *U: GV.users()) {
+            if (auto *CE = dyn_cast<ConstantExpr>(U)) {
+                constantUsers.push_back(CE);
+            }
+        }
+        for (ConstantExpr *CE: constantUsers) {
+            SmallPtrSet<Instruction *, 8> instUsers;
+            collectInstructionUsers(CE, instUsers);
+            for (Instruction *I: instUsers) {
+                convertConstantExprsToInstructions(I, CE);
+            }
+        }
+        GV.removeDeadConstantUsers();
+
+        log("global localize") << GV.getName().str() << " -> " << F->getName().str() << std::endl;
+        AllocaInst *alloca = createLocal(&GV, F);
+        GV.replaceAllUsesWith(alloca);
+        GV.eraseFromParent();
+
+        if (type->isArrayTy()) {
+            NumLocalizedArray++;
+        } else {
+            NumLocalizedScalar++;
+        }
+        changed = true;
+    }
+
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
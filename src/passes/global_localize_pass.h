@@ -0,0 +1,13 @@
+#ifndef SYSY_COMPILER_PASSES_GLOBAL_LOCALIZE_PASS_H
+#define SYSY_COMPILER_PASSES_GLOBAL_LOCALIZE_PASS_H
+
+#include <llvm/IR/PassManager.h>
+
+// 将只在一个仅执行一次的函数（main或只从main中被调用一次的函数）中使用的全局变量转换为局部变量
+// 标量随后可以被mem2reg提升到寄存器，较小的数组变为栈上数组，访问时不需要从文字池加载地址
+class GlobalLocalizePass : public llvm::PassInfoMixin<GlobalLocalizePass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+};
+
+#endif //SYSY_COMPILER_PASSES_GLOBAL_LOCALIZE_PASS_H
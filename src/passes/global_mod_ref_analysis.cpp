@@ -0,0 +1,180 @@
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include "log.h"
+#include "global_mod_ref_analysis.h"
+
+using namespace llvm;
+
+AnalysisKey GlobalModRefAnalysis::Key;
+
+// 获取指针访问的对象集合：全局变量，或经由数组参数访问到的对象
+// 函数自己的局部变量对调用者不可见，不计入；返回false表示无法确定
+static bool getAccessedObjects(const Value *ptr,
+                               const ArgPointsToAnalysis::Result &argPointsTo,
+                               SmallPtrSetImpl<const Value *> &objects) {
+    SmallVector<const Value *, 4> underlying;
+    getUnderlyingObjects(ptr, underlying, nullptr, 0);
+
+    for (const Value *obj: underlying) {
+        if (isa<AllocaInst>(obj)) {
+            continue;
+        }
+        if (isa<GlobalVariable>(obj)) {
+            objects.insert(obj);
+        } else if (auto *arg = dyn_cast<Argument>(obj)) {
+            auto *argObjects = argPointsTo.getPointsTo(arg);
+            if (!argObjects) {
+                return false;
+            }
+            objects.insert(argObjects->begin(), argObjects->end());
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+GlobalModRefResult GlobalModRefAnalysis::run(Module &M, ModuleAnalysisManager &AM) {
+    GlobalModRefResult result(AM.getResult<ArgPointsToAnalysis>(M));
+    auto &summaries = result.summaries;
+
+    // 记录一次访问，对象无法确定时将摘要标记为unknown
+    auto addAccess = [&](GlobalModRefResult::FunctionSummary &summary,
+                         const Value *ptr, bool read, bool write) {
+        SmallPtrSet<const Value *, 4> objects;
+        if (!getAccessedObjects(ptr, result.argPointsTo, objects)) {
+            summary.unknown = true;
+            return;
+        }
+        if (read) {
+            summary.read.insert(objects.begin(), objects.end());
+        }
+        if (write) {
+            summary.write.insert(objects.begin(), objects.end());
+        }
+    };
+
+    // 第一步：函数体内直接的访问，以及调用运行时库等外部函数产生的访问
+    for (Function &F: M) {
+        if (F.isDeclaration()) {
+            continue;
+        }
+        auto &summary = summaries[&F];
+        for (Instruction &I: instructions(F)) {
+            if (auto *LI = dyn_cast<LoadInst>(&I)) {
+                addAccess(summary, LI->getPointerOperand(), true, false);
+            } else if (auto *SI = dyn_cast<StoreInst>(&I)) {
+                addAccess(summary, SI->getPointerOperand(), false, true);
+            } else if (auto *CB = dyn_cast<CallBase>(&I)) {
+                Function *callee = CB->getCalledFunction();
+                if (callee && !callee->isDeclaration()) {
+                    continue;
+                }
+                if (CB->doesNotAccessMemory() || CB->onlyAccessesInaccessibleMemory()) {
+                    continue;
+                }
+                if (!CB->onlyAccessesArgMemory() && !CB->onlyAccessesInaccessibleMemOrArgMem()) {
+                    summary.unknown = true;
+                    continue;
+                }
+                for (unsigned i = 0; i < CB->arg_size(); i++) {
+                    const Value *arg = CB->getArgOperand(i);
+                    if (arg->getType()->isPointerTy() && !CB->doesNotAccessMemory(i)) {
+                        addAccess(summary, arg, !CB->onlyWritesMemory(i), !CB->onlyReadsMemory(i));
+                    }
+                }
+            } else if (I.mayReadOrWriteMemory()) {
+                summary.unknown = true;
+            }
+        }
+    }
+
+    // 第二步：沿调用图传播被调函数的摘要，直到不动点
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Function &F: M) {
+            if (F.isDeclaration()) {
+                continue;
+            }
+            for (Instruction &I: instructions(F)) {
+                auto *CB = dyn_cast<CallBase>(&I);
+                if (!CB || !CB->getCalledFunction() || CB->getCalledFunction() == &F) {
+                    continue;
+                }
+                auto it = summaries.find(CB->getCalledFunction());
+                if (it == summaries.end()) {
+                    continue;
+                }
+                // summaries在传播过程中不会插入新元素，引用不会失效
+                auto &callee = it->second;
+                auto &summary = summaries[&F];
+                if (callee.unknown && !summary.unknown) {
+                    summary.unknown = true;
+                    changed = true;
+                }
+                for (const Value *obj: callee.read) {
+                    changed |= summary.read.insert(obj).second;
+                }
+                for (const Value *obj: callee.write) {
+                    changed |= summary.write.insert(obj).second;
+                }
+            }
+        }
+    }
+
+    for (auto &[F, summary]: summaries) {
+        log("mod ref") << F->getName().str() << ": ref " << summary.read.size()
+                       << ", mod " << summary.write.size()
+                       << (summary.unknown ? ", unknown" : "") << std::endl;
+    }
+
+    return result;
+}
+
+ModRefInfo GlobalModRefResult::getModRefInfo(const CallBase *Call,
+                                             const MemoryLocation &Loc,
+                                             AAQueryInfo &AAQI) {
+    const Function *callee = Call->getCalledFunction();
+    auto it = callee ? summaries.find(callee) : summaries.end();
+    if (it == summaries.end() || it->second.unknown) {
+        return AAResultBase::getModRefInfo(Call, Loc, AAQI);
+    }
+
+    // 求出被查询位置可能属于的对象
+    // 调用者的局部数组只可能通过数组参数被访问到，已包含在被调函数的摘要中
+    SmallPtrSet<const Value *, 4> objects;
+    const Value *obj = getUnderlyingObject(Loc.Ptr, 0);
+    if (isa<GlobalVariable>(obj) || isa<AllocaInst>(obj)) {
+        objects.insert(obj);
+    } else if (!argPointsTo.getObjects(obj, objects)) {
+        return AAResultBase::getModRefInfo(Call, Loc, AAQI);
+    }
+
+    auto &summary = it->second;
+    ModRefInfo result = ModRefInfo::NoModRef;
+    for (const Value *object: objects) {
+        if (summary.read.count(object)) {
+            result = setRef(result);
+        }
+        if (summary.write.count(object)) {
+            result = setMod(result);
+        }
+    }
+    return result;
+}
+
+bool GlobalModRefResult::invalidate(
+        Module &M,
+        const PreservedAnalyses &PA,
+        ModuleAnalysisManager::Invalidator &
+) {
+    // 与ArgPointsToAnalysis相同，只能显式失效
+    auto PAC = PA.getChecker<GlobalModRefAnalysis>();
+    return !PAC.preservedWhenStateless();
+}
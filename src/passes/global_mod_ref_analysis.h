@@ -0,0 +1,53 @@
+#ifndef SYSY_COMPILER_PASSES_GLOBAL_MOD_REF_ANALYSIS_H
+#define SYSY_COMPILER_PASSES_GLOBAL_MOD_REF_ANALYSIS_H
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/IR/PassManager.h>
+#include "sysy_alias_analysis.h"
+
+// 过程间的全局变量读写摘要
+// 对每个函数求出它（及其所有被调函数）可能读、写的全局变量，以及经由数组参数访问到的调用者局部数组
+// 调用点上的别名查询据此判断调用是否会读写某个对象，使循环中的全局变量能跨调用保存在寄存器中
+class GlobalModRefResult : public llvm::AAResultBase<GlobalModRefResult> {
+    friend class GlobalModRefAnalysis;
+
+    struct FunctionSummary {
+        llvm::SmallPtrSet<const llvm::Value *, 8> read;
+        llvm::SmallPtrSet<const llvm::Value *, 8> write;
+        // 存在无法确定对象的访问
+        bool unknown = false;
+    };
+
+    const ArgPointsToAnalysis::Result &argPointsTo;
+    llvm::DenseMap<const llvm::Function *, FunctionSummary> summaries;
+
+    explicit GlobalModRefResult(const ArgPointsToAnalysis::Result &argPointsTo)
+            : argPointsTo(argPointsTo) {}
+
+public:
+    using AAResultBase::getModRefInfo;
+
+    llvm::ModRefInfo getModRefInfo(const llvm::CallBase *Call,
+                                   const llvm::MemoryLocation &Loc,
+                                   llvm::AAQueryInfo &AAQI);
+
+    bool invalidate(llvm::Module &M, const llvm::PreservedAnalyses &PA,
+                    llvm::ModuleAnalysisManager::Invalidator &);
+};
+
+// 模块级分析，通过AAManager::registerModuleAnalysis参与别名查询
+// 与GlobalsAA一样，需要在管道中使用RequireAnalysisPass提前计算
+class GlobalModRefAnalysis : public llvm::AnalysisInfoMixin<GlobalModRefAnalysis> {
+    friend llvm::AnalysisInfoMixin<GlobalModRefAnalysis>;
+
+    static llvm::AnalysisKey Key;
+
+public:
+    using Result = GlobalModRefResult;
+
+    GlobalModRefResult run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+};
+
+#endif //SYSY_COMPILER_PASSES_GLOBAL_MOD_REF_ANALYSIS_H
@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SCCIterator.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/CallGraph.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/OptimizationRemarkEmitter.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include "log.h"
+#include "inline_pass.h"
+
+using namespace llvm;
+using ore::NV;
+
+// 与LLVM自带的内联器同名，-Rpass=inline可以查看内联的结果
+#define DEBUG_TYPE "inline"
+
+STATISTIC(NumInlined, "Number of call sites inlined");
+STATISTIC(NumLeafInlined, "Number of call sites of small leaf functions inlined");
+STATISTIC(NumDeleted, "Number of functions deleted after inlining");
+
+static cl::opt<int> InlineThreshold(
+        "sysy-inline-threshold", cl::init(45), cl::Hidden,
+        cl::desc("Max inline cost of a call site outside loops"));
+
+// 循环中的调用点每次迭代都要付出调用开销，内联后还能参与循环优化，阈值随循环深度增大
+static cl::opt<int> LoopDepthBonus(
+        "sysy-inline-loop-depth-bonus", cl::init(60), cl::Hidden,
+        cl::desc("Threshold bonus for each loop level around a call site"));
+
+static cl::opt<unsigned> LeafThreshold(
+        "sysy-inline-leaf-threshold", cl::init(30), cl::Hidden,
+        cl::desc("Leaf functions at most this many instructions are always inlined"));
+
+// 整个模块因内联增加的指令数不超过原有指令数的百分比
+static cl::opt<unsigned> SizeBudget(
+        "sysy-inline-size-budget", cl::init(100), cl::Hidden,
+        cl::desc("Max module growth by inlining, in percent of the original size"));
+
+// 过大的函数会让寄存器分配效果变差
+static cl::opt<unsigned> CallerSizeLimit(
+        "sysy-inline-caller-size-limit", cl::init(3000), cl::Hidden,
+        cl::desc("Do not inline into functions larger than this many instructions"));
+
+// 循环深度的加成最多计算到的层数
+static const unsigned MaxBonusDepth = 3;
+// 预算过小时，至少允许增长的指令数
+static const unsigned MinBudget = 500;
+// 调用本身的开销：bl、保存和恢复寄存器、返回
+static const int CallCost = 4;
+// AAPCS中前4个整数参数通过寄存器传递，其余参数需要在栈上存储再加载
+static const unsigned RegisterArgs = 4;
+static const int StackArgCost = 2;
+// 常量实参内联后能够化简被调函数中的分支和运算
+static const int ConstantArgBonus = 5;
+
+namespace {
+
+    unsigned getInstructionCount(const Function &F) {
+        unsigned count = 0;
+        for (const BasicBlock &BB: F) {
+            for (const Instruction &I: BB) {
+                if (!isa<DbgInfoIntrinsic>(I) && !I.isLifetimeStartOrEnd()) {
+                    count++;
+                }
+            }
+        }
+        return count;
+    }
+
+    // 叶函数：除内置函数外没有调用，不需要保存lr，内联后也不会引入新的调用
+    bool isLeaf(const Function &F) {
+        for (const BasicBlock &BB: F) {
+            for (const Instruction &I: BB) {
+                if (isa<CallBase>(I) && !isa<IntrinsicInst>(I)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // 内联能省去的开销：调用本身、参数传递，以及常量实参带来的化简机会
+    int getCallSavings(const CallBase &CB) {
+        int savings = CallCost;
+        for (unsigned i = 0; i < CB.arg_size(); i++) {
+            savings += i < RegisterArgs ? 1 : StackArgCost;
+            if (isa<Constant>(CB.getArgOperand(i))) {
+                savings += ConstantArgBonus;
+            }
+        }
+        return savings;
+    }
+
+    struct CallSite {
+        CallBase *CB;
+        unsigned depth;
+    };
+
+    class Inliner {
+        Module &M;
+        FunctionAnalysisManager &FAM;
+        DenseMap<const Function *, unsigned> sizes;
+        int64_t budget;
+        bool changed = false;
+
+    public:
+        Inliner(Module &M, FunctionAnalysisManager &FAM) : M(M), FAM(FAM) {
+            uint64_t moduleSize = 0;
+            for (const Function &F: M) {
+                if (!F.isDeclaration()) {
+                    sizes[&F] = getInstructionCount(F);
+                    moduleSize += sizes[&F];
+                }
+            }
+            budget = std::max<int64_t>(moduleSize * SizeBudget / 100, MinBudget);
+        }
+
+        bool run() {
+            // 按调用图的后序（被调函数在前）处理强连通分量，
+            // 递归函数之间（同一个强连通分量内）的调用不内联
+            CallGraph CG(M);
+            std::vector<std::vector<Function *>> SCCs;
+            for (auto it = scc_begin(&CG); !it.isAtEnd(); ++it) {
+                std::vector<Function *> SCC;
+                for (CallGraphNode *node: *it) {
+                    Function *F = node->getFunction();
+                    if (F && !F->isDeclaration()) {
+                        SCC.push_back(F);
+                    }
+                }
+                if (!SCC.empty()) {
+                    SCCs.push_back(std::move(SCC));
+                }
+            }
+
+            for (auto &SCC: SCCs) {
+                SmallPtrSet<Function *, 4> members(SCC.begin(), SCC.end());
+                for (Function *F: SCC) {
+                    inlineCallsIn(*F, members);
+                }
+            }
+
+            // 所有调用都被内联的内部函数不再需要
+            SmallVector<Function *, 8> dead;
+            for (Function &F: M) {
+                if (!F.isDeclaration() && F.hasLocalLinkage() && F.use_empty()) {
+                    dead.push_back(&F);
+                }
+            }
+            for (Function *F: dead) {
+                log("inline") << "delete " << F->getName().str() << std::endl;
+                FAM.clear(*F, F->getName());
+                F->eraseFromParent();
+                NumDeleted++;
+                changed = true;
+            }
+            return changed;
+        }
+
+    private:
+        void inlineCallsIn(Function &caller, const SmallPtrSet<Function *, 4> &SCC) {
+            auto &LI = FAM.getResult<LoopAnalysis>(caller);
+            SmallVector<CallSite, 16> callSites;
+            for (BasicBlock &BB: caller) {
+                for (Instruction &I: BB) {
+                    auto *CB = dyn_cast<CallBase>(&I);
+                    if (!CB) {
+                        continue;
+                    }
+                    Function *callee = CB->getCalledFunction();
+                    if (!callee || callee->isDeclaration() || callee->isVarArg() || SCC.count(callee) ||
+                        callee->hasFnAttribute(Attribute::NoInline) ||
+                        callee->getFunctionType() != CB->getFunctionType()) {
+                        continue;
+                    }
+                    callSites.push_back({CB, LI.getLoopDepth(&BB)});
+                }
+            }
+            if (callSites.empty()) {
+                return;
+            }
+
+            // 循环深处的调用点优先使用预算
+            std::stable_sort(callSites.begin(), callSites.end(), [](const CallSite &a, const CallSite &b) {
+                return a.depth > b.depth;
+            });
+
+            auto &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(caller);
+            bool inlined = false;
+            for (const CallSite &site: callSites) {
+                if (tryInline(*site.CB, site.depth, ORE)) {
+                    inlined = true;
+                }
+            }
+            if (inlined) {
+                sizes[&caller] = getInstructionCount(caller);
+                FAM.invalidate(caller, PreservedAnalyses::none());
+                changed = true;
+            }
+        }
+
+        bool tryInline(CallBase &CB, unsigned depth, OptimizationRemarkEmitter &ORE) {
+            Function *caller = CB.getFunction();
+            Function *callee = CB.getCalledFunction();
+            unsigned calleeSize = sizes[callee];
+            int cost = (int) calleeSize - getCallSavings(CB);
+            int threshold = InlineThreshold + LoopDepthBonus * (int) std::min(depth, MaxBonusDepth);
+            // 内部函数的最后一个调用点被内联后函数本身会被删除，代码不会增长
+            bool lastCall = callee->hasLocalLinkage() && callee->hasOneUse();
+            bool leaf = calleeSize <= LeafThreshold && isLeaf(*callee);
+
+            const char *reason = nullptr;
+            if (sizes[caller] + calleeSize > CallerSizeLimit && !leaf) {
+                reason = "caller too large";
+            } else if (!leaf && !lastCall) {
+                if (cost > threshold) {
+                    reason = "too costly";
+                } else if ((int64_t) calleeSize > budget) {
+                    reason = "size budget exhausted";
+                }
+            }
+            if (reason) {
+                ORE.emit([&] {
+                    return OptimizationRemarkMissed(DEBUG_TYPE, "NotInlined", &CB)
+                            << NV("Callee", callee) << " not inlined into " << NV("Caller", caller)
+                            << ": " << reason << " (cost=" << NV("Cost", cost)
+                            << ", threshold=" << NV("Threshold", threshold) << ")";
+                });
+                return false;
+            }
+
+            // 内联后调用指令被删除，先生成备注
+            OptimizationRemark remark(DEBUG_TYPE, "Inlined", &CB);
+            remark << NV("Callee", callee) << " inlined into " << NV("Caller", caller)
+                   << " (cost=" << NV("Cost", cost) << ", threshold=" << NV("Threshold", threshold) << ")";
+
+            InlineFunctionInfo IFI;
+            if (!InlineFunction(CB, IFI).isSuccess()) {
+                return false;
+            }
+            ORE.emit(remark);
+            log("inline") << callee->getName().str() << " -> " << caller->getName().str()
+                          << " cost " << cost << " threshold " << threshold << std::endl;
+
+            sizes[caller] += calleeSize;
+            if (leaf) {
+                NumLeafInlined++;
+            } else if (!lastCall) {
+                budget -= calleeSize;
+            }
+            NumInlined++;
+            return true;
+        }
+    };
+}
+
+PreservedAnalyses InlinePass::run(Module &M, ModuleAnalysisManager &AM) {
+    auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    return Inliner(M, FAM).run() ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
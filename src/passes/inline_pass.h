@@ -0,0 +1,14 @@
+#ifndef SYSY_COMPILER_PASSES_INLINE_PASS_H
+#define SYSY_COMPILER_PASSES_INLINE_PASS_H
+
+#include <llvm/IR/PassManager.h>
+
+// 函数内联：沿调用图自底向上处理，被调函数中的调用已经内联完毕后再决定是否内联到调用者
+// 代价为被调函数的IR指令数减去调用开销，阈值随调用点所在的循环深度增大；
+// 较小的叶函数总是内联，其余的内联受整个模块的代码增长预算限制
+class InlinePass : public llvm::PassInfoMixin<InlinePass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+};
+
+#endif //SYSY_COMPILER_PASSES_INLINE_PASS_H
@@ -0,0 +1,780 @@
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <llvm/IR/GetElementPtrTypeIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/Support/MathExtras.h>
+#include "ir_interpreter.h"
+
+using namespace llvm;
+
+// 递归调用的最大深度
+static const unsigned MaxCallDepth = 5000;
+
+static int globalObject(unsigned index) {
+    return -2 - (int) index;
+}
+
+static bool isGlobalObject(int object) {
+    return object <= -2;
+}
+
+static unsigned getBitWidth(const Type *type) {
+    return type->isPointerTy() ? 64 : type->getIntegerBitWidth();
+}
+
+static uint64_t truncate(uint64_t value, unsigned bits) {
+    return bits >= 64 ? value : value & ((1ull << bits) - 1);
+}
+
+static int64_t signExtend(uint64_t value, unsigned bits) {
+    return bits >= 64 ? (int64_t) value : SignExtend64(value, bits);
+}
+
+// 只支持SysY中会出现的标量类型
+static bool isSupportedScalar(const Type *type) {
+    return (type->isIntegerTy() && type->getIntegerBitWidth() <= 64) || type->isFloatTy();
+}
+
+struct IRInterpreter::Frame {
+    DenseMap<const llvm::Value *, Value> values;
+    const BasicBlock *block = nullptr;
+    const BasicBlock *prevBlock = nullptr;
+    const BasicBlock *nextBlock = nullptr;
+    bool returned = false;
+    Value result;
+};
+
+bool IRInterpreter::call(Function &F, ArrayRef<Value> args, Value &result) {
+    int minObject;
+    return run(F, args, result, 0, minObject);
+}
+
+Constant *IRInterpreter::toConstant(const Value &value, Type *type) {
+    if (type->isIntegerTy()) {
+        return ConstantInt::get(type, value.i);
+    }
+    if (type->isFloatTy()) {
+        return ConstantFP::get(type, value.f);
+    }
+    return nullptr;
+}
+
+bool IRInterpreter::getConstantValue(const Constant *C, Value &value) {
+    return getValue(C, nullptr, value);
+}
+
+std::vector<uint8_t> *IRInterpreter::getGlobalMemory(const GlobalVariable &GV) {
+    auto it = globalIndex.find(&GV);
+    if (it != globalIndex.end()) {
+        return &globals[it->second];
+    }
+    if (!GV.hasInitializer() || GV.isInterposable()) {
+        return nullptr;
+    }
+    uint64_t size = DL.getTypeAllocSize(GV.getValueType());
+    if (size > memoryLimit - memoryUsed) {
+        return nullptr;
+    }
+    std::vector<uint8_t> memory(size);
+    if (!storeConstant(memory, 0, GV.getInitializer())) {
+        return nullptr;
+    }
+    memoryUsed += size;
+    globalIndex[&GV] = (int) globals.size();
+    globals.push_back(std::move(memory));
+    globalVars.push_back(&GV);
+    return &globals.back();
+}
+
+bool IRInterpreter::storeConstant(std::vector<uint8_t> &memory, uint64_t offset, const Constant *C) {
+    Type *type = C->getType();
+    if (isa<ConstantAggregateZero>(C) || isa<UndefValue>(C)) {
+        return true;
+    }
+    if (isSupportedScalar(type)) {
+        Value value;
+        if (!getConstantValue(C, value)) {
+            return false;
+        }
+        uint64_t size = DL.getTypeStoreSize(type);
+        if (type->isFloatTy()) {
+            std::memcpy(&memory[offset], &value.f, size);
+        } else {
+            std::memcpy(&memory[offset], &value.i, size);
+        }
+        return true;
+    }
+    if (auto *structType = dyn_cast<StructType>(type)) {
+        const StructLayout *layout = DL.getStructLayout(structType);
+        for (unsigned i = 0; i < structType->getNumElements(); i++) {
+            if (!storeConstant(memory, offset + layout->getElementOffset(i), C->getAggregateElement(i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (auto *arrayType = dyn_cast<ArrayType>(type)) {
+        uint64_t elementSize = DL.getTypeAllocSize(arrayType->getElementType());
+        for (uint64_t i = 0; i < arrayType->getNumElements(); i++) {
+            if (!storeConstant(memory, offset + i * elementSize, C->getAggregateElement(i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+uint8_t *IRInterpreter::access(const Value &pointer, uint64_t size, bool write) {
+    std::vector<uint8_t> *memory;
+    if (isGlobalObject(pointer.object)) {
+        unsigned index = -2 - pointer.object;
+        const GlobalVariable *GV = globalVars[index];
+        if (!canAccessGlobal(*GV, write)) {
+            return nullptr;
+        }
+        // 可变的全局变量不只由参数决定
+        if (!GV->isConstant()) {
+            minAccessed = INT_MIN;
+        }
+        memory = &globals[index];
+    } else if (pointer.object >= 0 && pointer.object < (int) stack.size()) {
+        minAccessed = std::min(minAccessed, pointer.object);
+        memory = &stack[pointer.object];
+    } else {
+        return nullptr;
+    }
+    if (pointer.offset < 0 || pointer.offset + size > memory->size()) {
+        return nullptr;
+    }
+    return memory->data() + pointer.offset;
+}
+
+bool IRInterpreter::load(const Value &pointer, Type *type, Value &value) {
+    if (!isSupportedScalar(type)) {
+        return false;
+    }
+    uint64_t size = DL.getTypeStoreSize(type);
+    uint8_t *data = access(pointer, size, false);
+    if (!data) {
+        return false;
+    }
+    value = Value();
+    if (type->isFloatTy()) {
+        std::memcpy(&value.f, data, size);
+    } else {
+        std::memcpy(&value.i, data, size);
+        value.i = truncate(value.i, type->getIntegerBitWidth());
+    }
+    return true;
+}
+
+bool IRInterpreter::store(const Value &pointer, const Value &value, Type *type) {
+    if (!isSupportedScalar(type)) {
+        return false;
+    }
+    uint64_t size = DL.getTypeStoreSize(type);
+    uint8_t *data = access(pointer, size, true);
+    if (!data) {
+        return false;
+    }
+    if (type->isFloatTy()) {
+        std::memcpy(data, &value.f, size);
+    } else {
+        std::memcpy(data, &value.i, size);
+    }
+    return true;
+}
+
+bool IRInterpreter::evalGEP(const User *GEP, Frame *frame, Value &value) {
+    if (!getValue(GEP->getOperand(0), frame, value)) {
+        return false;
+    }
+    for (auto it = gep_type_begin(GEP), end = gep_type_end(GEP); it != end; ++it) {
+        Value index;
+        if (!getValue(it.getOperand(), frame, index)) {
+            return false;
+        }
+        int64_t idx = signExtend(index.i, getBitWidth(it.getOperand()->getType()));
+        if (StructType *structType = it.getStructTypeOrNull()) {
+            value.offset += (int64_t) DL.getStructLayout(structType)->getElementOffset(idx);
+        } else {
+            value.offset += idx * (int64_t) DL.getTypeAllocSize(it.getIndexedType());
+        }
+    }
+    return true;
+}
+
+bool IRInterpreter::getValue(const llvm::Value *V, Frame *frame, Value &value) {
+    value = Value();
+    if (auto *CI = dyn_cast<ConstantInt>(V)) {
+        if (CI->getBitWidth() > 64) {
+            return false;
+        }
+        value.i = CI->getZExtValue();
+        return true;
+    }
+    if (auto *CF = dyn_cast<ConstantFP>(V)) {
+        if (!CF->getType()->isFloatTy()) {
+            return false;
+        }
+        value.f = CF->getValueAPF().convertToFloat();
+        return true;
+    }
+    if (isa<ConstantPointerNull>(V) || isa<UndefValue>(V)) {
+        return true;
+    }
+    if (auto *GV = dyn_cast<GlobalVariable>(V)) {
+        if (!getGlobalMemory(*GV)) {
+            return false;
+        }
+        value.object = globalObject(globalIndex[GV]);
+        return true;
+    }
+    if (auto *CE = dyn_cast<ConstantExpr>(V)) {
+        if (isa<GEPOperator>(CE)) {
+            return evalGEP(CE, frame, value);
+        }
+        if (CE->getOpcode() == Instruction::BitCast && CE->getType()->isPointerTy()) {
+            return getValue(CE->getOperand(0), frame, value);
+        }
+        return false;
+    }
+    if (!frame) {
+        return false;
+    }
+    auto it = frame->values.find(V);
+    if (it == frame->values.end()) {
+        return false;
+    }
+    value = it->second;
+    return true;
+}
+
+bool IRInterpreter::isRecursive(const Function &F) {
+    auto it = recursive.find(&F);
+    if (it != recursive.end()) {
+        return it->second;
+    }
+    bool result = false;
+    for (const BasicBlock &BB: F) {
+        for (const Instruction &I: BB) {
+            auto *CB = dyn_cast<CallBase>(&I);
+            if (CB && CB->getCalledFunction() == &F) {
+                result = true;
+            }
+        }
+    }
+    recursive[&F] = result;
+    return result;
+}
+
+bool IRInterpreter::run(Function &F, ArrayRef<Value> args, Value &result, unsigned depth, int &minObject) {
+    if (depth > MaxCallDepth || F.isDeclaration() || F.isVarArg()) {
+        return false;
+    }
+
+    // 递归函数的参数都是标量时，查找之前相同参数的调用结果
+    bool cacheable = isRecursive(F);
+    std::vector<uint64_t> key;
+    for (unsigned i = 0; i < F.arg_size(); i++) {
+        Type *type = F.getArg(i)->getType();
+        cacheable = cacheable && !type->isPointerTy();
+        if (type->isFloatTy()) {
+            uint32_t bits;
+            std::memcpy(&bits, &args[i].f, sizeof(bits));
+            key.push_back(bits);
+        } else {
+            key.push_back(args[i].i);
+        }
+    }
+    if (cacheable) {
+        auto it = callCache.find({&F, key});
+        if (it != callCache.end()) {
+            result = it->second;
+            minObject = INT_MAX;
+            return true;
+        }
+    }
+
+    int mark = (int) stack.size();
+    int savedMinAccessed = minAccessed;
+    minAccessed = INT_MAX;
+
+    Frame frame;
+    for (unsigned i = 0; i < F.arg_size(); i++) {
+        frame.values[F.getArg(i)] = args[i];
+    }
+    frame.block = &F.getEntryBlock();
+    bool success = true;
+    while (success && !frame.returned) {
+        // phi在块的入口处同时赋值
+        SmallVector<std::pair<const PHINode *, Value>, 8> phiValues;
+        for (const PHINode &phi: frame.block->phis()) {
+            Value value;
+            if (!frame.prevBlock || !getValue(phi.getIncomingValueForBlock(frame.prevBlock), &frame, value)) {
+                success = false;
+                break;
+            }
+            phiValues.emplace_back(&phi, value);
+        }
+        for (auto &[phi, value]: phiValues) {
+            frame.values[phi] = value;
+        }
+
+        frame.nextBlock = nullptr;
+        for (auto it = frame.block->getFirstNonPHI()->getIterator(); success && it != frame.block->end(); ++it) {
+            if (fuel == 0) {
+                success = false;
+                break;
+            }
+            fuel--;
+            success = execute(*it, frame, depth);
+            if (frame.returned || frame.nextBlock) {
+                break;
+            }
+        }
+        if (success && !frame.returned) {
+            if (!frame.nextBlock) {
+                success = false;
+                break;
+            }
+            frame.prevBlock = frame.block;
+            frame.block = frame.nextBlock;
+        }
+    }
+
+    // 释放本次调用分配的栈上对象
+    for (auto it = stack.begin() + mark; it != stack.end(); ++it) {
+        memoryUsed -= it->size();
+    }
+    stack.resize(mark);
+    minObject = minAccessed;
+    minAccessed = std::min(savedMinAccessed, minAccessed);
+    if (!success) {
+        return false;
+    }
+    result = frame.result;
+    if (cacheable && minObject >= mark) {
+        callCache[{&F, key}] = result;
+    }
+    return true;
+}
+
+bool IRInterpreter::executeCall(const CallBase &CB, Frame &frame, unsigned depth) {
+    Function *callee = CB.getCalledFunction();
+    if (!callee) {
+        return false;
+    }
+
+    SmallVector<Value, 8> args;
+    for (const Use &arg: CB.args()) {
+        Value value;
+        if (!getValue(arg.get(), &frame, value)) {
+            return false;
+        }
+        args.push_back(value);
+    }
+
+    Value result;
+    if (auto *II = dyn_cast<IntrinsicInst>(&CB)) {
+        switch (II->getIntrinsicID()) {
+            case Intrinsic::lifetime_start:
+            case Intrinsic::lifetime_end:
+            case Intrinsic::assume:
+            case Intrinsic::dbg_declare:
+            case Intrinsic::dbg_value:
+                return true;
+            case Intrinsic::memset: {
+                uint64_t size = args[2].i;
+                uint8_t *data = access(args[0], size, true);
+                if (!data) {
+                    return false;
+                }
+                std::memset(data, (int) args[1].i, size);
+                return true;
+            }
+            case Intrinsic::memcpy:
+            case Intrinsic::memmove: {
+                uint64_t size = args[2].i;
+                uint8_t *src = access(args[1], size, false);
+                uint8_t *dst = src ? access(args[0], size, true) : nullptr;
+                if (!dst) {
+                    return false;
+                }
+                std::memmove(dst, src, size);
+                return true;
+            }
+            case Intrinsic::smax:
+            case Intrinsic::smin:
+            case Intrinsic::umax:
+            case Intrinsic::umin: {
+                unsigned bits = getBitWidth(CB.getType());
+                int64_t a = signExtend(args[0].i, bits), b = signExtend(args[1].i, bits);
+                switch (II->getIntrinsicID()) {
+                    case Intrinsic::smax:
+                        result.i = truncate(std::max(a, b), bits);
+                        break;
+                    case Intrinsic::smin:
+                        result.i = truncate(std::min(a, b), bits);
+                        break;
+                    case Intrinsic::umax:
+                        result.i = std::max(args[0].i, args[1].i);
+                        break;
+                    default:
+                        result.i = std::min(args[0].i, args[1].i);
+                        break;
+                }
+                break;
+            }
+            case Intrinsic::abs: {
+                unsigned bits = getBitWidth(CB.getType());
+                int64_t a = signExtend(args[0].i, bits);
+                result.i = truncate(a < 0 ? -a : a, bits);
+                break;
+            }
+            default:
+                return false;
+        }
+        frame.values[&CB] = result;
+        return true;
+    }
+
+    if (callee->isDeclaration()) {
+        // 外部函数的行为不只由参数决定
+        minAccessed = INT_MIN;
+        if (!callExternal(CB, args, result)) {
+            return false;
+        }
+    } else {
+        int minObject;
+        if (!run(*callee, args, result, depth + 1, minObject)) {
+            return false;
+        }
+    }
+    frame.values[&CB] = result;
+    return true;
+}
+
+bool IRInterpreter::execute(const Instruction &I, Frame &frame, unsigned depth) {
+    Type *type = I.getType();
+    if (type->isVectorTy()) {
+        return false;
+    }
+
+    Value result;
+    switch (I.getOpcode()) {
+        case Instruction::Ret: {
+            if (I.getNumOperands() && !getValue(I.getOperand(0), &frame, frame.result)) {
+                return false;
+            }
+            frame.returned = true;
+            return true;
+        }
+        case Instruction::Br: {
+            auto &BI = cast<BranchInst>(I);
+            if (BI.isUnconditional()) {
+                frame.nextBlock = BI.getSuccessor(0);
+                return true;
+            }
+            Value cond;
+            if (!getValue(BI.getCondition(), &frame, cond)) {
+                return false;
+            }
+            frame.nextBlock = BI.getSuccessor(cond.i ? 0 : 1);
+            return true;
+        }
+        case Instruction::Switch: {
+            auto &SI = cast<SwitchInst>(I);
+            Value cond;
+            if (!getValue(SI.getCondition(), &frame, cond)) {
+                return false;
+            }
+            frame.nextBlock = SI.getDefaultDest();
+            for (auto &c: SI.cases()) {
+                if (c.getCaseValue()->getZExtValue() == cond.i) {
+                    frame.nextBlock = c.getCaseSuccessor();
+                    break;
+                }
+            }
+            return true;
+        }
+        case Instruction::Alloca: {
+            auto &AI = cast<AllocaInst>(I);
+            auto *count = dyn_cast<ConstantInt>(AI.getArraySize());
+            if (!count) {
+                return false;
+            }
+            uint64_t size = DL.getTypeAllocSize(AI.getAllocatedType()) * count->getZExtValue();
+            if (size > memoryLimit - memoryUsed) {
+                return false;
+            }
+            memoryUsed += size;
+            result.object = (int) stack.size();
+            stack.emplace_back(size);
+            break;
+        }
+        case Instruction::Load: {
+            auto &LI = cast<LoadInst>(I);
+            Value pointer;
+            if (LI.isVolatile() || !getValue(LI.getPointerOperand(), &frame, pointer) ||
+                !load(pointer, type, result)) {
+                return false;
+            }
+            break;
+        }
+        case Instruction::Store: {
+            auto &SI = cast<StoreInst>(I);
+            Value pointer, value;
+            return !SI.isVolatile() &&
+                   getValue(SI.getPointerOperand(), &frame, pointer) &&
+                   getValue(SI.getValueOperand(), &frame, value) &&
+                   store(pointer, value, SI.getValueOperand()->getType());
+        }
+        case Instruction::GetElementPtr: {
+            if (!evalGEP(&I, &frame, result)) {
+                return false;
+            }
+            break;
+        }
+        case Instruction::Call: {
+            return executeCall(cast<CallBase>(I), frame, depth);
+        }
+        case Instruction::Select: {
+            auto &SI = cast<SelectInst>(I);
+            Value cond;
+            if (!getValue(SI.getCondition(), &frame, cond) ||
+                !getValue(cond.i ? SI.getTrueValue() : SI.getFalseValue(), &frame, result)) {
+                return false;
+            }
+            break;
+        }
+        case Instruction::Freeze: {
+            if (!getValue(I.getOperand(0), &frame, result)) {
+                return false;
+            }
+            break;
+        }
+        case Instruction::ICmp: {
+            auto &CI = cast<ICmpInst>(I);
+            Value lhs, rhs;
+            if (!getValue(CI.getOperand(0), &frame, lhs) || !getValue(CI.getOperand(1), &frame, rhs)) {
+                return false;
+            }
+            Type *operandType = CI.getOperand(0)->getType();
+            if (operandType->isPointerTy()) {
+                if (!CI.isEquality()) {
+                    return false;
+                }
+                bool equal = lhs.object == rhs.object && lhs.offset == rhs.offset;
+                result.i = CI.getPredicate() == CmpInst::ICMP_EQ ? equal : !equal;
+                break;
+            }
+            unsigned bits = getBitWidth(operandType);
+            uint64_t a = lhs.i, b = rhs.i;
+            int64_t sa = signExtend(a, bits), sb = signExtend(b, bits);
+            switch (CI.getPredicate()) {
+                case CmpInst::ICMP_EQ: result.i = a == b; break;
+                case CmpInst::ICMP_NE: result.i = a != b; break;
+                case CmpInst::ICMP_SLT: result.i = sa < sb; break;
+                case CmpInst::ICMP_SLE: result.i = sa <= sb; break;
+                case CmpInst::ICMP_SGT: result.i = sa > sb; break;
+                case CmpInst::ICMP_SGE: result.i = sa >= sb; break;
+                case CmpInst::ICMP_ULT: result.i = a < b; break;
+                case CmpInst::ICMP_ULE: result.i = a <= b; break;
+                case CmpInst::ICMP_UGT: result.i = a > b; break;
+                case CmpInst::ICMP_UGE: result.i = a >= b; break;
+                default: return false;
+            }
+            break;
+        }
+        case Instruction::FCmp: {
+            auto &CI = cast<FCmpInst>(I);
+            Value lhs, rhs;
+            if (!getValue(CI.getOperand(0), &frame, lhs) || !getValue(CI.getOperand(1), &frame, rhs)) {
+                return false;
+            }
+            float a = lhs.f, b = rhs.f;
+            bool unordered = std::isnan(a) || std::isnan(b);
+            switch (CI.getPredicate()) {
+                case CmpInst::FCMP_FALSE: result.i = 0; break;
+                case CmpInst::FCMP_TRUE: result.i = 1; break;
+                case CmpInst::FCMP_ORD: result.i = !unordered; break;
+                case CmpInst::FCMP_UNO: result.i = unordered; break;
+                case CmpInst::FCMP_OEQ: result.i = !unordered && a == b; break;
+                case CmpInst::FCMP_ONE: result.i = !unordered && a != b; break;
+                case CmpInst::FCMP_OLT: result.i = !unordered && a < b; break;
+                case CmpInst::FCMP_OLE: result.i = !unordered && a <= b; break;
+                case CmpInst::FCMP_OGT: result.i = !unordered && a > b; break;
+                case CmpInst::FCMP_OGE: result.i = !unordered && a >= b; break;
+                case CmpInst::FCMP_UEQ: result.i = unordered || a == b; break;
+                case CmpInst::FCMP_UNE: result.i = unordered || a != b; break;
+                case CmpInst::FCMP_ULT: result.i = unordered || a < b; break;
+                case CmpInst::FCMP_ULE: result.i = unordered || a <= b; break;
+                case CmpInst::FCMP_UGT: result.i = unordered || a > b; break;
+                case CmpInst::FCMP_UGE: result.i = unordered || a >= b; break;
+                default: return false;
+            }
+            break;
+        }
+        case Instruction::FNeg: {
+            Value operand;
+            if (!getValue(I.getOperand(0), &frame, operand)) {
+                return false;
+            }
+            result.f = -operand.f;
+            break;
+        }
+        case Instruction::Add:
+        case Instruction::Sub:
+        case Instruction::Mul:
+        case Instruction::SDiv:
+        case Instruction::SRem:
+        case Instruction::UDiv:
+        case Instruction::URem:
+        case Instruction::Shl:
+        case Instruction::LShr:
+        case Instruction::AShr:
+        case Instruction::And:
+        case Instruction::Or:
+        case Instruction::Xor: {
+            Value lhs, rhs;
+            if (!getValue(I.getOperand(0), &frame, lhs) || !getValue(I.getOperand(1), &frame, rhs)) {
+                return false;
+            }
+            unsigned bits = getBitWidth(type);
+            uint64_t a = lhs.i, b = rhs.i;
+            int64_t sa = signExtend(a, bits), sb = signExtend(b, bits);
+            int64_t signedMin = signExtend(1ull << (bits - 1), bits);
+            switch (I.getOpcode()) {
+                case Instruction::Add: result.i = a + b; break;
+                case Instruction::Sub: result.i = a - b; break;
+                case Instruction::Mul: result.i = a * b; break;
+                case Instruction::SDiv:
+                case Instruction::SRem: {
+                    // 除以0和最小值除以-1是未定义行为
+                    if (sb == 0 || (sa == signedMin && sb == -1)) {
+                        return false;
+                    }
+                    result.i = I.getOpcode() == Instruction::SDiv ? sa / sb : sa % sb;
+                    break;
+                }
+                case Instruction::UDiv:
+                case Instruction::URem: {
+                    if (b == 0) {
+                        return false;
+                    }
+                    result.i = I.getOpcode() == Instruction::UDiv ? a / b : a % b;
+                    break;
+                }
+                case Instruction::Shl:
+                case Instruction::LShr:
+                case Instruction::AShr: {
+                    if (b >= bits) {
+                        return false;
+                    }
+                    if (I.getOpcode() == Instruction::Shl) {
+                        result.i = a << b;
+                    } else if (I.getOpcode() == Instruction::LShr) {
+                        result.i = a >> b;
+                    } else {
+                        result.i = sa >> b;
+                    }
+                    break;
+                }
+                case Instruction::And: result.i = a & b; break;
+                case Instruction::Or: result.i = a | b; break;
+                default: result.i = a ^ b; break;
+            }
+            result.i = truncate(result.i, bits);
+            break;
+        }
+        case Instruction::FAdd:
+        case Instruction::FSub:
+        case Instruction::FMul:
+        case Instruction::FDiv:
+        case Instruction::FRem: {
+            Value lhs, rhs;
+            if (!type->isFloatTy() ||
+                !getValue(I.getOperand(0), &frame, lhs) || !getValue(I.getOperand(1), &frame, rhs)) {
+                return false;
+            }
+            switch (I.getOpcode()) {
+                case Instruction::FAdd: result.f = lhs.f + rhs.f; break;
+                case Instruction::FSub: result.f = lhs.f - rhs.f; break;
+                case Instruction::FMul: result.f = lhs.f * rhs.f; break;
+                case Instruction::FDiv: result.f = lhs.f / rhs.f; break;
+                default: result.f = std::fmod(lhs.f, rhs.f); break;
+            }
+            break;
+        }
+        case Instruction::Trunc:
+        case Instruction::ZExt:
+        case Instruction::SExt:
+        case Instruction::SIToFP:
+        case Instruction::UIToFP:
+        case Instruction::FPToSI:
+        case Instruction::FPToUI:
+        case Instruction::BitCast: {
+            Value operand;
+            if (!getValue(I.getOperand(0), &frame, operand)) {
+                return false;
+            }
+            Type *srcType = I.getOperand(0)->getType();
+            switch (I.getOpcode()) {
+                case Instruction::Trunc:
+                    result.i = truncate(operand.i, getBitWidth(type));
+                    break;
+                case Instruction::ZExt:
+                    result.i = operand.i;
+                    break;
+                case Instruction::SExt:
+                    result.i = truncate(signExtend(operand.i, getBitWidth(srcType)), getBitWidth(type));
+                    break;
+                case Instruction::SIToFP:
+                    result.f = (float) signExtend(operand.i, getBitWidth(srcType));
+                    break;
+                case Instruction::UIToFP:
+                    result.f = (float) operand.i;
+                    break;
+                case Instruction::FPToSI:
+                case Instruction::FPToUI: {
+                    // 超出范围的转换结果是poison
+                    unsigned bits = getBitWidth(type);
+                    if (!std::isfinite(operand.f) || std::fabs(operand.f) >= std::ldexp(1.0f, (int) bits - 1)) {
+                        return false;
+                    }
+                    if (I.getOpcode() == Instruction::FPToUI && operand.f <= -1.0f) {
+                        return false;
+                    }
+                    result.i = truncate((uint64_t) (int64_t) operand.f, bits);
+                    break;
+                }
+                default: {
+                    // 指针之间的转换不改变值，int和float之间按位重新解释
+                    if (type->isPointerTy() && srcType->isPointerTy()) {
+                        result = operand;
+                    } else if (type->isFloatTy() && srcType->isIntegerTy(32)) {
+                        auto bits = (uint32_t) operand.i;
+                        std::memcpy(&result.f, &bits, sizeof(bits));
+                    } else if (type->isIntegerTy(32) && srcType->isFloatTy()) {
+                        uint32_t bits;
+                        std::memcpy(&bits, &operand.f, sizeof(bits));
+                        result.i = bits;
+                    } else {
+                        return false;
+                    }
+                    break;
+                }
+            }
+            break;
+        }
+        default:
+            return false;
+    }
+    frame.values[&I] = result;
+    return true;
+}
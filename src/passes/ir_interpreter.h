@@ -0,0 +1,99 @@
+#ifndef SYSY_COMPILER_PASSES_IR_INTERPRETER_H
+#define SYSY_COMPILER_PASSES_IR_INTERPRETER_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/InstrTypes.h>
+
+// 编译期的IR解释器，执行步数（IR指令数）受fuel限制，分配的内存（全局变量和栈上对象）受memoryLimit限制
+// 支持整数/浮点运算、控制流、函数调用以及局部数组和全局变量的读写；
+// 遇到不支持的指令、未定义行为或不允许的操作时执行失败，由调用者放弃变换
+// 默认只允许读取常量全局变量，不允许调用外部函数，子类可以放宽限制
+class IRInterpreter {
+public:
+    // 指针指向的内存对象编号：非负数为栈上对象，-1为空指针，-2及以下为全局变量
+    static constexpr int NullObject = -1;
+
+    // 解释执行中的值：整数（按位宽零扩展保存）、浮点数，或者指针（内存对象与字节偏移）
+    struct Value {
+        uint64_t i = 0;
+        float f = 0;
+        int object = NullObject;
+        int64_t offset = 0;
+    };
+
+    IRInterpreter(const llvm::DataLayout &DL, uint64_t fuel, uint64_t memoryLimit)
+            : DL(DL), fuel(fuel), memoryLimit(memoryLimit) {}
+
+    virtual ~IRInterpreter() = default;
+
+    // 执行函数F，成功时result为返回值
+    bool call(llvm::Function &F, llvm::ArrayRef<Value> args, Value &result);
+
+    // 将常量转换为解释器中的值，不支持时返回false
+    bool getConstantValue(const llvm::Constant *C, Value &value);
+
+    // 将标量值转换为给定类型的常量
+    static llvm::Constant *toConstant(const Value &value, llvm::Type *type);
+
+    uint64_t getRemainingFuel() const {
+        return fuel;
+    }
+
+protected:
+    // 是否允许读写全局变量，默认只允许读取常量
+    virtual bool canAccessGlobal(const llvm::GlobalVariable &GV, bool write) {
+        return !write && GV.isConstant();
+    }
+
+    // 调用只有声明的外部函数（运行时库），默认不允许
+    virtual bool callExternal(const llvm::CallBase &, llvm::ArrayRef<Value>, Value &) {
+        return false;
+    }
+
+    // 读写内存对象中的数据，越界或对象不可访问时返回nullptr
+    uint8_t *access(const Value &pointer, uint64_t size, bool write);
+
+    // 全局变量对应的内存，第一次访问时由初值构造
+    std::vector<uint8_t> *getGlobalMemory(const llvm::GlobalVariable &GV);
+
+    const llvm::DataLayout &DL;
+
+private:
+    struct Frame;
+
+    bool isRecursive(const llvm::Function &F);
+    bool run(llvm::Function &F, llvm::ArrayRef<Value> args, Value &result, unsigned depth, int &minObject);
+    bool execute(const llvm::Instruction &I, Frame &frame, unsigned depth);
+    bool executeCall(const llvm::CallBase &CB, Frame &frame, unsigned depth);
+    bool getValue(const llvm::Value *V, Frame *frame, Value &value);
+    bool evalGEP(const llvm::User *GEP, Frame *frame, Value &value);
+    bool load(const Value &pointer, llvm::Type *type, Value &value);
+    bool store(const Value &pointer, const Value &value, llvm::Type *type);
+    bool storeConstant(std::vector<uint8_t> &memory, uint64_t offset, const llvm::Constant *C);
+
+    uint64_t fuel;
+    // 全局变量和栈上对象的总字节数，超过上限时执行失败
+    uint64_t memoryLimit;
+    uint64_t memoryUsed = 0;
+    // 栈上的对象按分配顺序保存，函数返回时释放自己分配的对象
+    std::vector<std::vector<uint8_t>> stack;
+    std::vector<std::vector<uint8_t>> globals;
+    std::vector<const llvm::GlobalVariable *> globalVars;
+    llvm::DenseMap<const llvm::GlobalVariable *, int> globalIndex;
+    // 访问到的最小的对象编号，用于判断函数调用是否只访问自己的局部变量
+    int minAccessed = 0;
+    // 只访问自己局部变量、参数均为标量的调用，结果只由参数决定，可以缓存
+    // 只缓存直接递归的函数，其余函数用相同参数重复调用的情况很少
+    llvm::DenseMap<const llvm::Function *, bool> recursive;
+    std::map<std::pair<const llvm::Function *, std::vector<uint64_t>>, Value> callCache;
+};
+
+#endif //SYSY_COMPILER_PASSES_IR_INTERPRETER_H
@@ -8,6 +8,7 @@
 #include <llvm/Analysis/LoopPass.h>
 #include <llvm/Analysis/MemorySSA.h>
 #include <llvm/Analysis/OptimizationRemarkEmitter.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
 #include <llvm/IR/Dominators.h>
 
 #include <llvm/IR/PatternMatch.h>
@@ -15,6 +16,7 @@
 #include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/Scalar/LoopPassManager.h>
 #include <llvm/Transforms/Utils/LoopUtils.h>
+#include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
 
 using namespace llvm;
 
@@ -23,12 +25,19 @@ using namespace llvm;
 STATISTIC(NumDelete, "Number of loops deleted");
 STATISTIC(NumBackedgesBroken,
           "Number of loops for which we managed to break the backedge");
+STATISTIC(NumExitValuesRewritten, "Number of loop exit values replaced by closed forms");
 
 static cl::opt<bool> EnableSymbolicExecution(
         "self-loop-deletion-enable-symbolic-execution", cl::Hidden, cl::init(true),
         cl::desc("Break backedge through symbolic execution of 1st iteration "
                  "attempting to prove that the backedge is never taken"));
 
+// 替换掉整个循环时，闭式表达式可以比LLVM默认的廉价展开预算（4条指令）贵得多，
+// 如等差数列求和需要乘法、移位和更宽的整数运算
+static cl::opt<unsigned> ExitValueBudget(
+        "loop-deletion-exit-value-budget", cl::Hidden, cl::init(40),
+        cl::desc("Max cost of the closed-form exit values computed to delete a loop"));
+
 // 三种状态：未修改、修改、删除
 enum class LoopDeletionResult {
     Unmodified,
@@ -45,9 +54,19 @@ static LoopDeletionResult merge(LoopDeletionResult A, LoopDeletionResult B) {
     return LoopDeletionResult::Unmodified;
 }
 
+// 循环内是否有写内存、调用等副作用
+static bool mayHaveSideEffects(Loop *L) {
+    for (auto &I : L->blocks())
+        if (any_of(*I, [](Instruction &I) {
+            return I.mayHaveSideEffects() && !I.isDroppable();
+        }))
+            return true;
+    return false;
+}
+
 // 判断L是否为死循环。死循环要求流入exit块中PHI节点的都是循环不变量并且从不同exiting块流入的数据都相同,并且循环内部未与环境产生交互,并且不能是while(1)这类无法预估的无限循环
 // 约束条件是exit只有一个，有exiting块，为LCSSA形式
-// 传入的Changed是False
+// 传入的Changed表示之前是否已经修改过循环（如改写了出口值）
 static bool isLoopDead(Loop *L, ScalarEvolution &SE,
                        SmallVectorImpl<BasicBlock *> &ExitingBlocks,
                        BasicBlock *ExitBlock, bool &Changed,
@@ -93,11 +112,8 @@ static bool isLoopDead(Loop *L, ScalarEvolution &SE,
         return false;
 
     // 还有一种情况也非死循环(不可删除)：在循环内进行了写内存、使用volatile属性变量等操作
-    for (auto &I : L->blocks())
-        if (any_of(*I, [](Instruction &I) {
-            return I.mayHaveSideEffects() && !I.isDroppable();
-        }))
-            return false;
+    if (mayHaveSideEffects(L))
+        return false;
 
     // 1.mustprogress说明Loop内没有进行I/O输出等与环境交互的操作，可以删除
     // 2.当Loop的子循环全都是mustprogress的或者有有限运行次数限制时，也看做死循环，可以删除
@@ -134,6 +150,46 @@ static bool isLoopDead(Loop *L, ScalarEvolution &SE,
     return true;
 }
 
+// 用SCEV求出循环外使用的值在出口处的闭式表达式（如计数、等差数列求和、不变量的累加），
+// 在出口块中直接计算，替换掉exit块中的LCSSA PHI节点，之后循环就可能成为死循环
+// 要求只有一个exiting块，出口处的值才是循环执行BTC次回边后的值
+// 只在循环没有副作用时进行，否则循环仍然保留，多计算的闭式表达式只会增加开销
+static bool rewriteExitValues(Loop *L, BasicBlock *ExitBlock, ScalarEvolution &SE,
+                              const TargetTransformInfo *TTI) {
+    if (!TTI || !L->getExitingBlock() || mayHaveSideEffects(L))
+        return false;
+
+    // 先求出所有的闭式表达式，有一个无法求出时就不改写
+    Instruction *InsertPt = &*ExitBlock->getFirstInsertionPt();
+    auto &DL = ExitBlock->getModule()->getDataLayout();
+    SCEVExpander Rewriter(SE, DL, "exitval");
+    SmallVector<std::pair<PHINode *, const SCEV *>, 4> Rewrites;
+    for (PHINode &P : ExitBlock->phis()) {
+        Value *Incoming = P.getIncomingValue(0);
+        if (L->isLoopInvariant(Incoming))
+            continue;
+        if (!SE.isSCEVable(P.getType()))
+            return false;
+        const SCEV *ExitValue = SE.getSCEVAtScope(Incoming, L->getParentLoop());
+        if (isa<SCEVCouldNotCompute>(ExitValue) || !SE.isLoopInvariant(ExitValue, L) ||
+            !isSafeToExpandAt(ExitValue, InsertPt, SE) ||
+            Rewriter.isHighCostExpansion(ExitValue, L, ExitValueBudget, TTI, InsertPt))
+            return false;
+        Rewrites.emplace_back(&P, ExitValue);
+    }
+    if (Rewrites.empty())
+        return false;
+
+    for (auto [P, ExitValue] : Rewrites) {
+        Value *V = Rewriter.expandCodeFor(ExitValue, P->getType(), InsertPt);
+        SE.forgetValue(P);
+        P->replaceAllUsesWith(V);
+        P->eraseFromParent();
+        ++NumExitValuesRewritten;
+    }
+    return true;
+}
+
 // 如果没有可进入L的入口块，说明L永不被运行，返回True
 static bool isLoopNeverExecuted(Loop *L) {
     using namespace PatternMatch;
@@ -423,6 +479,7 @@ breakBackedgeIfNotTaken(Loop *L, DominatorTree &DT, ScalarEvolution &SE,
 // 如果循环被删除，返回Deleted；如果出现不变量外提的操作返回Modified，否则返回Unmodified
 static LoopDeletionResult deleteLoopIfDead(Loop *L, DominatorTree &DT,
                                            ScalarEvolution &SE, LoopInfo &LI,
+                                           const TargetTransformInfo *TTI,
                                            MemorySSA *MSSA,
                                            OptimizationRemarkEmitter &ORE) {
     assert(L->isLCSSAForm(DT) && "Expected LCSSA!");
@@ -466,8 +523,10 @@ static LoopDeletionResult deleteLoopIfDead(Loop *L, DominatorTree &DT,
         return LoopDeletionResult::Unmodified;
     }
 
+    // 循环外使用的值先改写为出口处的闭式表达式，没有副作用的循环就只剩下循环不变的出口值
+    bool Changed = ExitBlock && rewriteExitValues(L, ExitBlock, SE, TTI);
+
     // 如果Loop并非死循环(没被删除)，判断它是否被修改过(不变量外提)，根据传回来的Changed判断
-    bool Changed = false;
     if (!isLoopDead(L, SE, ExitingBlocks, ExitBlock, Changed, Preheader, LI)) {
         LLVM_DEBUG(dbgs() << "Loop is not invariant, cannot delete.\n");
         return Changed ? LoopDeletionResult::Modified
@@ -495,7 +554,7 @@ PreservedAnalyses LoopDeletionPass::run(Loop &L, LoopAnalysisManager &AM,
 
     // 执行死循环删除
     OptimizationRemarkEmitter ORE(L.getHeader()->getParent());
-    auto Result = deleteLoopIfDead(&L, AR.DT, AR.SE, AR.LI, AR.MSSA, ORE);
+    auto Result = deleteLoopIfDead(&L, AR.DT, AR.SE, AR.LI, &AR.TTI, AR.MSSA, ORE);
 
     // 如果没找到死循环删除，执行一下breakBackedgeIfNotTaken，该函数可能产生新的死循环并删除(但会保留原Loop结构)。最终的Result状态取Result和该函数状态的较大值
     if (Result != LoopDeletionResult::Deleted)
@@ -553,7 +612,8 @@ bool LoopDeletionLegacyPass::runOnLoop(Loop *L, LPPassManager &LPM) {
         MSSA = &MSSAAnalysis->getMSSA();
     OptimizationRemarkEmitter ORE(L->getHeader()->getParent());
 
-    LoopDeletionResult Result = deleteLoopIfDead(L, DT, SE, LI, MSSA, ORE);
+    // 旧版Pass没有TTI，不改写出口值
+    LoopDeletionResult Result = deleteLoopIfDead(L, DT, SE, LI, nullptr, MSSA, ORE);
 
     if (Result != LoopDeletionResult::Deleted)
         Result = merge(Result, breakBackedgeIfNotTaken(L, DT, SE, LI, MSSA, ORE));
@@ -0,0 +1,418 @@
+#include <optional>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Transforms/Utils/Local.h>
+#include <llvm/Transforms/Utils/LoopSimplify.h>
+#include "log.h"
+#include "loop_fusion_pass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "loop-fusion"
+
+STATISTIC(NumFused, "Number of loops fused");
+
+// 这里同时计入跨迭代的值和循环不变量（数组基址、边界等），它们在合并后的整个循环中都占用寄存器；
+// r0-r12和lr中留出两个给地址和比较的临时值，上限为10
+static cl::opt<unsigned> MaxLiveValues(
+        "sysy-fusion-max-live", cl::init(10), cl::Hidden,
+        cl::desc("Max number of values live across a fused innermost loop"));
+
+namespace {
+
+    struct FusionCandidate {
+        Loop *first;
+        Loop *second;
+        // 从第一个循环的出口块到第二个循环的preheader的块
+        SmallVector<BasicBlock *, 4> chain;
+        // 之间的块中被第二个循环使用、需要移到第一个循环之前的指令
+        SmallPtrSet<Instruction *, 4> hoisted;
+    };
+
+    struct MemoryAccesses {
+        SmallVector<Instruction *, 16> accesses;
+        // 只读写不可访问内存的调用（输入输出）
+        bool hasIO = false;
+    };
+
+} // namespace
+
+// 未旋转的循环：只在循环头退出，循环体不在循环头中
+static bool isUnrotated(Loop *L) {
+    return L->isLoopSimplifyForm() && L->getExitingBlock() == L->getHeader() &&
+           L->getLoopLatch() != L->getHeader() && L->getExitBlock();
+}
+
+static unsigned getNestDepth(Loop *L) {
+    unsigned depth = 1;
+    for (Loop *sub: L->getSubLoops()) {
+        depth = std::max(depth, getNestDepth(sub) + 1);
+    }
+    return depth;
+}
+
+// 从L1的出口沿只有一个前驱和后继的块找到紧接着的同层循环
+static Loop *findNextLoop(Loop *L1, LoopInfo &LI, SmallVectorImpl<BasicBlock *> &chain) {
+    if (!isUnrotated(L1)) {
+        return nullptr;
+    }
+    BasicBlock *BB = L1->getExitBlock();
+    while (chain.size() < 8) {
+        chain.push_back(BB);
+        auto *br = dyn_cast<BranchInst>(BB->getTerminator());
+        if (!br || br->isConditional()) {
+            return nullptr;
+        }
+        BasicBlock *succ = br->getSuccessor(0);
+        if (LI.isLoopHeader(succ)) {
+            Loop *L2 = LI.getLoopFor(succ);
+            bool adjacent = L2->getParentLoop() == L1->getParentLoop() && L2->getLoopPreheader() == BB;
+            return adjacent && isUnrotated(L2) ? L2 : nullptr;
+        }
+        if (!succ->getSinglePredecessor() || LI.getLoopFor(succ) != L1->getParentLoop()) {
+            return nullptr;
+        }
+        BB = succ;
+    }
+    return nullptr;
+}
+
+static bool collectAccesses(Loop *L, MemoryAccesses &MA) {
+    for (BasicBlock *BB: L->blocks()) {
+        for (Instruction &I: *BB) {
+            if (isa<LoadInst>(I) || isa<StoreInst>(I)) {
+                if (!getLoadStorePointerOperand(&I) || (isa<LoadInst>(I) && !cast<LoadInst>(I).isSimple()) ||
+                    (isa<StoreInst>(I) && !cast<StoreInst>(I).isSimple())) {
+                    return false;
+                }
+                MA.accesses.push_back(&I);
+            } else if (auto *call = dyn_cast<CallInst>(&I)) {
+                if (call->onlyAccessesInaccessibleMemory()) {
+                    MA.hasIO = true;
+                } else if (call->mayReadOrWriteMemory() || !call->willReturn()) {
+                    return false;
+                }
+            } else if (I.mayReadOrWriteMemory() || I.mayHaveSideEffects()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// 循环中的访问在循环上的步长超过一个元素（如转置中的b[j][i]）
+static bool hasStridedAccess(Loop *L, ScalarEvolution &SE) {
+    for (BasicBlock *BB: L->blocks()) {
+        for (Instruction &I: *BB) {
+            Value *ptr = getLoadStorePointerOperand(&I);
+            auto *AR = ptr ? dyn_cast<SCEVAddRecExpr>(SE.getSCEV(ptr)) : nullptr;
+            auto *step = AR && AR->getLoop() == L ? dyn_cast<SCEVConstant>(AR->getStepRecurrence(SE)) : nullptr;
+            if (step && step->getAPInt().abs().ugt(getLoadStoreType(&I)->getPrimitiveSizeInBits() / 8)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// 合并后，第二个循环第i次迭代中的访问B不会与第一个循环第i次之后的迭代中的访问A访问同一位置
+// 某一维的下标在A、B中分别为两个循环的仿射归纳变量{sA,+,c}、{sB,+,c}时，
+// 下标相等要求两者的迭代序号相差(sB - sA) / c，这个差不为正（或不能整除）时即可
+static bool isFusionSafe(Instruction *A, Loop *L1, Instruction *B, Loop *L2,
+                         ScalarEvolution &SE, AAResults &AA) {
+    Value *ptrA = getLoadStorePointerOperand(A), *ptrB = getLoadStorePointerOperand(B);
+    if (AA.isNoAlias(MemoryLocation::getBeforeOrAfter(ptrA), MemoryLocation::getBeforeOrAfter(ptrB))) {
+        return true;
+    }
+    auto *gepA = dyn_cast<GEPOperator>(ptrA), *gepB = dyn_cast<GEPOperator>(ptrB);
+    if (!gepA || !gepB || gepA->getPointerOperand() != gepB->getPointerOperand() ||
+        gepA->getSourceElementType() != gepB->getSourceElementType() ||
+        gepA->getNumIndices() != gepB->getNumIndices()) {
+        return false;
+    }
+    for (unsigned i = 1; i < gepA->getNumOperands(); i++) {
+        if (!SE.isSCEVable(gepA->getOperand(i)->getType())) {
+            continue;
+        }
+        auto *ARA = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(gepA->getOperand(i)));
+        auto *ARB = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(gepB->getOperand(i)));
+        if (!ARA || !ARB || ARA->getLoop() != L1 || ARB->getLoop() != L2 || !ARA->isAffine() || !ARB->isAffine() ||
+            !ARA->hasNoSelfWrap() || !ARB->hasNoSelfWrap() ||
+            !SE.isLoopInvariant(ARA->getStart(), L1) || !SE.isLoopInvariant(ARB->getStart(), L2)) {
+            continue;
+        }
+        auto *step = dyn_cast<SCEVConstant>(ARA->getStepRecurrence(SE));
+        auto *diff = dyn_cast<SCEVConstant>(SE.getMinusSCEV(ARB->getStart(), ARA->getStart()));
+        if (!step || step != ARB->getStepRecurrence(SE) || step->isZero() || !diff) {
+            continue;
+        }
+        const APInt &c = step->getAPInt(), &d = diff->getAPInt();
+        if (d.srem(c) != 0 || d.sdiv(c).isNonPositive()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 合并后最内层循环中跨迭代的值和循环不变量的个数，步长相同的归纳变量会被合并
+static unsigned estimateLiveValues(Loop *L1, Loop *L2) {
+    unsigned live = 0;
+    for (Loop *L: {L1, L2}) {
+        for (PHINode &phi: L->getHeader()->phis()) {
+            live += L == L1 || !phi.getType()->isIntegerTy();
+        }
+    }
+    SmallPtrSet<Value *, 16> invariants;
+    for (Loop *L: {L1, L2}) {
+        for (BasicBlock *BB: L->blocks()) {
+            for (Instruction &I: *BB) {
+                auto *call = dyn_cast<CallInst>(&I);
+                for (Value *op: I.operands()) {
+                    auto *inst = dyn_cast<Instruction>(op);
+                    if ((call && op == call->getCalledOperand()) ||
+                        (inst && (L1->contains(inst) || L2->contains(inst)))) {
+                        continue;
+                    }
+                    if (inst || isa<Argument>(op) || isa<GlobalValue>(op)) {
+                        invariants.insert(op);
+                    }
+                }
+            }
+        }
+    }
+    return live + invariants.size();
+}
+
+// 检查两个循环之间的指令和第二个循环使用的值，记录需要移到第一个循环之前的指令
+static bool checkScalarFlow(FusionCandidate &FC) {
+    Loop *L1 = FC.first, *L2 = FC.second;
+    SmallPtrSet<BasicBlock *, 4> chain(FC.chain.begin(), FC.chain.end());
+    SmallVector<Instruction *, 8> worklist;
+    auto use = [&](Value *V) {
+        auto *inst = dyn_cast<Instruction>(V);
+        if (!inst) {
+            return true;
+        }
+        if (L1->contains(inst) || (chain.count(inst->getParent()) && isa<PHINode>(inst))) {
+            return false;
+        }
+        if (chain.count(inst->getParent()) && FC.hoisted.insert(inst).second) {
+            worklist.push_back(inst);
+        }
+        return true;
+    };
+
+    // 第二个循环不能使用第一个循环中计算的值
+    for (BasicBlock *BB: L2->blocks()) {
+        for (Instruction &I: *BB) {
+            if (!all_of(I.operands(), use)) {
+                return false;
+            }
+        }
+    }
+    // 第二个循环使用的、之间的块中的指令移到第一个循环之前，需要可以提前执行
+    while (!worklist.empty()) {
+        Instruction *I = worklist.pop_back_val();
+        if (I->mayReadOrWriteMemory() || !isSafeToSpeculativelyExecute(I) || !all_of(I->operands(), use)) {
+            return false;
+        }
+    }
+    // 其余的指令在合并后的循环之后执行，不能有副作用
+    for (BasicBlock *BB: FC.chain) {
+        for (Instruction &I: *BB) {
+            if (!FC.hoisted.count(&I) && (I.mayReadOrWriteMemory() || I.mayHaveSideEffects())) {
+                return false;
+            }
+        }
+    }
+
+    // 第二个循环的循环头在合并后少执行一次，其中的值不能在循环外使用
+    for (Instruction &I: *L2->getHeader()) {
+        if (isa<PHINode>(I)) {
+            continue;
+        }
+        if (I.mayHaveSideEffects() || any_of(I.users(), [&](User *U) {
+            return !L2->contains(cast<Instruction>(U));
+        })) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool canFuse(FusionCandidate &FC, ScalarEvolution &SE, AAResults &AA) {
+    Loop *L1 = FC.first, *L2 = FC.second;
+    const SCEV *BTC = SE.getBackedgeTakenCount(L1);
+    if (isa<SCEVCouldNotCompute>(BTC) || BTC != SE.getBackedgeTakenCount(L2)) {
+        return false;
+    }
+
+    // 两层嵌套的内层循环的迭代次数也要相同，且在嵌套中不变
+    unsigned depth = getNestDepth(L1);
+    if (depth > 2 || depth != getNestDepth(L2)) {
+        return false;
+    }
+    if (depth == 2) {
+        if (L1->getSubLoops().size() != 1 || L2->getSubLoops().size() != 1) {
+            return false;
+        }
+        Loop *inner1 = L1->getSubLoops().front(), *inner2 = L2->getSubLoops().front();
+        const SCEV *innerBTC = SE.getBackedgeTakenCount(inner1);
+        if (isa<SCEVCouldNotCompute>(innerBTC) || innerBTC != SE.getBackedgeTakenCount(inner2) ||
+            !SE.isLoopInvariant(innerBTC, L1) || !SE.isLoopInvariant(innerBTC, L2)) {
+            return false;
+        }
+        // 内层循环中有不连续的访问时，循环嵌套的交换与分块会改变这个嵌套的循环顺序，
+        // 合并后的嵌套按其中一个的顺序统一，不再合并
+        if (hasStridedAccess(inner1, SE) || hasStridedAccess(inner2, SE)) {
+            return false;
+        }
+    } else if (estimateLiveValues(L1, L2) > MaxLiveValues) {
+        return false;
+    }
+
+    if (!checkScalarFlow(FC)) {
+        return false;
+    }
+
+    MemoryAccesses MA1, MA2;
+    if (!collectAccesses(L1, MA1) || !collectAccesses(L2, MA2) || (MA1.hasIO && MA2.hasIO)) {
+        return false;
+    }
+    // 没有共同访问的数组时合并不能减少访存
+    SmallPtrSet<const Value *, 8> objects;
+    for (Instruction *A: MA1.accesses) {
+        objects.insert(getUnderlyingObject(getLoadStorePointerOperand(A)));
+    }
+    if (none_of(MA2.accesses, [&](Instruction *B) {
+        return objects.count(getUnderlyingObject(getLoadStorePointerOperand(B)));
+    })) {
+        return false;
+    }
+    for (Instruction *A: MA1.accesses) {
+        for (Instruction *B: MA2.accesses) {
+            if ((isa<StoreInst>(A) || isa<StoreInst>(B)) && !isFusionSafe(A, L1, B, L2, SE, AA)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// 与header中另一个phi初值和步长都相同的归纳变量
+static PHINode *findEquivalentIV(PHINode *phi, BasicBlock *preheader, BasicBlock *latch) {
+    auto *inc = dyn_cast<BinaryOperator>(phi->getIncomingValueForBlock(latch));
+    if (!inc || inc->getOperand(0) != phi || !isa<Constant>(inc->getOperand(1))) {
+        return nullptr;
+    }
+    for (PHINode &other: phi->getParent()->phis()) {
+        auto *otherInc = dyn_cast<BinaryOperator>(other.getIncomingValueForBlock(latch));
+        if (&other != phi && other.getType() == phi->getType() &&
+            other.getIncomingValueForBlock(preheader) == phi->getIncomingValueForBlock(preheader) &&
+            otherInc && otherInc->getOperand(0) == &other && otherInc->getOpcode() == inc->getOpcode() &&
+            otherInc->getOperand(1) == inc->getOperand(1)) {
+            return &other;
+        }
+    }
+    return nullptr;
+}
+
+// 合并：第二个循环的phi移到第一个循环的循环头，第一个循环的latch接到第二个循环的循环体，
+// 第二个循环的latch回到第一个循环的循环头，之间的块在合并后的循环退出后执行，然后跳到第二个循环的出口
+static void fuse(FusionCandidate &FC) {
+    Loop *L1 = FC.first, *L2 = FC.second;
+    BasicBlock *preheader1 = L1->getLoopPreheader(), *header1 = L1->getHeader(), *latch1 = L1->getLoopLatch();
+    BasicBlock *preheader2 = L2->getLoopPreheader(), *header2 = L2->getHeader(), *latch2 = L2->getLoopLatch();
+    BasicBlock *exit2 = L2->getExitBlock();
+
+    for (BasicBlock *BB: FC.chain) {
+        for (Instruction &I: make_early_inc_range(*BB)) {
+            if (FC.hoisted.count(&I)) {
+                I.moveBefore(preheader1->getTerminator());
+            }
+        }
+    }
+
+    for (PHINode &phi: header1->phis()) {
+        phi.setIncomingBlock(phi.getBasicBlockIndex(latch1), latch2);
+    }
+    SmallVector<PHINode *, 4> moved;
+    for (PHINode &phi: make_early_inc_range(header2->phis())) {
+        phi.setIncomingBlock(phi.getBasicBlockIndex(preheader2), preheader1);
+        phi.moveBefore(header1->getFirstNonPHI());
+        moved.push_back(&phi);
+    }
+
+    auto *br2 = cast<BranchInst>(header2->getTerminator());
+    BasicBlock *body2 = br2->getSuccessor(br2->getSuccessor(0) == exit2 ? 1 : 0);
+    Value *cond2 = br2->getCondition();
+    BranchInst::Create(body2, br2);
+    br2->eraseFromParent();
+    RecursivelyDeleteTriviallyDeadInstructions(cond2);
+
+    latch1->getTerminator()->replaceUsesOfWith(header1, header2);
+    latch2->getTerminator()->replaceUsesOfWith(header2, header1);
+    preheader2->getTerminator()->replaceUsesOfWith(header2, exit2);
+    for (PHINode &phi: exit2->phis()) {
+        phi.setIncomingBlock(phi.getBasicBlockIndex(header2), preheader2);
+    }
+
+    // 两个循环的归纳变量通常相同（如都是从0开始的i），只保留第一个
+    for (PHINode *phi: moved) {
+        if (PHINode *equivalent = findEquivalentIV(phi, preheader1, latch2)) {
+            Value *inc = phi->getIncomingValueForBlock(latch2);
+            phi->replaceAllUsesWith(equivalent);
+            phi->eraseFromParent();
+            RecursivelyDeleteTriviallyDeadInstructions(inc);
+        }
+    }
+}
+
+PreservedAnalyses LoopFusionPass::run(Function &F, FunctionAnalysisManager &FAM) {
+    // 每次合并后重新计算分析结果，合并后的循环的子循环可能成为新的相邻循环
+    bool changed = false;
+    while (true) {
+        auto &LI = FAM.getResult<LoopAnalysis>(F);
+        auto &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+        auto &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+        auto &AA = FAM.getResult<AAManager>(F);
+        auto &AC = FAM.getResult<AssumptionAnalysis>(F);
+
+        for (Loop *L: LI.getLoopsInPreorder()) {
+            if (!L->isLoopSimplifyForm()) {
+                changed |= simplifyLoop(L, &DT, &LI, &SE, &AC, nullptr, false);
+            }
+        }
+
+        std::optional<FusionCandidate> FC;
+        for (Loop *L: LI.getLoopsInPreorder()) {
+            FusionCandidate candidate{L};
+            candidate.second = findNextLoop(L, LI, candidate.chain);
+            if (candidate.second && canFuse(candidate, SE, AA)) {
+                FC = std::move(candidate);
+                break;
+            }
+        }
+        if (!FC) {
+            break;
+        }
+
+        log("fusion") << F.getName().str() << ": " << FC->first->getHeader()->getName().str() << " + "
+                           << FC->second->getHeader()->getName().str() << std::endl;
+        fuse(*FC);
+        FAM.invalidate(F, PreservedAnalyses::none());
+        NumFused++;
+        changed = true;
+    }
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
@@ -0,0 +1,21 @@
+#ifndef SYSY_COMPILER_PASSES_LOOP_FUSION_PASS_H
+#define SYSY_COMPILER_PASSES_LOOP_FUSION_PASS_H
+
+#include <llvm/IR/PassManager.h>
+
+// 循环合并：相邻的两个同层循环（如先初始化数组再计算、矩阵相加后输出）迭代次数相同时，
+// 把第二个循环的循环体接在第一个循环的循环体之后，数组只需经过cache一次
+// 两个循环之间只能有没有副作用的计算，第二个循环不能使用第一个循环中计算的值
+// 合法性：合并后第二个循环的第i次迭代先于第一个循环的第i次之后的迭代执行，
+// 两者访问同一数组且至少一个是写时，要求某一维的下标都是合并的循环的归纳变量加常量，
+// 第二个循环的下标不超前于第一个循环（如先写a[i]后读a[i]或a[i - 1]），各维下标在范围内时就不会访问同一元素
+// 代价：两个循环至少访问一个相同的数组才合并；最内层循环合并后活跃的值超过可用寄存器时不合并；
+// 只合并两层以内的嵌套，两层嵌套的内层循环迭代次数也要相同，合并后内层循环可以继续合并，
+// 三层的完美嵌套和内层循环中有不连续访问（如转置）的两层嵌套留给矩阵乘法的替换和循环嵌套的交换与分块
+// 在循环旋转之前进行，此时循环只在循环头退出，两个循环的迭代次数就是回边的执行次数
+class LoopFusionPass : public llvm::PassInfoMixin<LoopFusionPass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+};
+
+#endif //SYSY_COMPILER_PASSES_LOOP_FUSION_PASS_H
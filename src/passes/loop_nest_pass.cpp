@@ -0,0 +1,744 @@
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/DependenceAnalysis.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/LoopIterator.h>
+#include <llvm/Analysis/OptimizationRemarkEmitter.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+#include "log.h"
+#include "loop_nest_pass.h"
+#include "target_machine.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "loop-nest"
+
+STATISTIC(NumInterchanged, "Number of loop nests interchanged");
+STATISTIC(NumTiled, "Number of loop nests tiled");
+
+// 为0时使用-mcpu=所选CPU的L1数据cache容量
+static cl::opt<unsigned> CacheSize(
+        "loop-tile-cache-size", cl::init(0), cl::Hidden,
+        cl::desc("Data cache size in bytes used to decide and size loop tiling (0 uses the target CPU's)"));
+
+static cl::opt<unsigned> TileSizeOption(
+        "loop-tile-size", cl::init(0), cl::Hidden,
+        cl::desc("Tile size of tiled loops (0 derives it from the cache size)"));
+
+static constexpr unsigned MaxNestDepth = 3;
+static constexpr unsigned MinTileSize = 8;
+// 跨行访问时块内的每次迭代都是不同的cache行，行距为2的幂时这些行落在cache的同一组中，
+// 又各自占用一个TLB项，块过大时会因组冲突和TLB缺失被换出
+static constexpr unsigned MaxTileSize = 64;
+// 迭代次数不是常量、也无法由数组大小推出时假定的值
+static constexpr uint64_t DefaultTripCount = 1024;
+// 一个函数中最多变换的循环嵌套数
+static constexpr unsigned MaxNestsPerFunction = 16;
+
+namespace {
+
+    // 嵌套中的一层循环：for (iv = start; iv pred end; iv++)，pred为slt或ult
+    struct Level {
+        Loop *L;
+        PHINode *iv;
+        Value *start;
+        Value *end;
+        ICmpInst::Predicate pred;
+    };
+
+    // 最内层循环中的访存，strides为地址在每层循环上的步长（字节），不是仿射的访问为nullopt
+    struct Access {
+        Instruction *I;
+        uint64_t size;
+        // 访问的数组的大小，未知时为0
+        uint64_t objectSize;
+        SmallVector<std::optional<int64_t>, MaxNestDepth> strides;
+    };
+
+    // 依赖在嵌套各层上的方向，每项是DVEntry::LT、EQ、GT的组合
+    using Direction = SmallVector<unsigned, MaxNestDepth>;
+
+    struct Nest {
+        SmallVector<Level, MaxNestDepth> levels;
+        SmallVector<Access, 16> accesses;
+        // 不被嵌套外的循环携带的依赖
+        SmallVector<Direction, 16> dependences;
+    };
+
+    // 新嵌套中的一层：原来的一整层循环、分块后的块循环或块内的循环
+    struct Dim {
+        enum Kind {
+            Whole,
+            Tile,
+            Point
+        } kind;
+        unsigned level;
+    };
+
+} // namespace
+
+static std::optional<Level> analyzeLevel(Loop *L, ScalarEvolution &SE) {
+    if (!L->isLoopSimplifyForm() || !L->isRotatedForm() || !L->getExitBlock() ||
+        L->getExitingBlock() != L->getLoopLatch()) {
+        return std::nullopt;
+    }
+    PHINode *iv = L->getInductionVariable(SE);
+    auto bounds = L->getBounds(SE);
+    if (!iv || !bounds) {
+        return std::nullopt;
+    }
+    auto *step = dyn_cast_or_null<ConstantInt>(bounds->getStepValue());
+    ICmpInst *latchCmp = L->getLatchCmpInst();
+    if (!step || !step->isOne() || !latchCmp ||
+        (latchCmp->getOperand(0) != &bounds->getStepInst() && latchCmp->getOperand(1) != &bounds->getStepInst())) {
+        return std::nullopt;
+    }
+
+    Value *start = &bounds->getInitialIVValue();
+    Value *end = &bounds->getFinalIVValue();
+    ICmpInst::Predicate pred = bounds->getCanonicalPredicate();
+    // start不大于end时iv != end等价于iv < end
+    if (pred == ICmpInst::ICMP_NE &&
+        SE.isKnownPredicate(ICmpInst::ICMP_SLE, SE.getSCEV(start), SE.getSCEV(end))) {
+        pred = ICmpInst::ICMP_SLT;
+    }
+    if ((pred != ICmpInst::ICMP_SLT && pred != ICmpInst::ICMP_ULT) || !L->isLoopInvariant(end)) {
+        return std::nullopt;
+    }
+
+    // 除归纳变量外不能有其他跨迭代的值
+    for (PHINode &phi: L->getHeader()->phis()) {
+        if (&phi != iv) {
+            return std::nullopt;
+        }
+    }
+    return Level{L, iv, start, end, pred};
+}
+
+// 判断分支是否为内层循环的保护条件，即start pred end成立时进入内层循环
+static bool isGuard(BranchInst *br, const Level &inner, ScalarEvolution &SE,
+                    BasicBlock *&enter, BasicBlock *&skip) {
+    auto *cmp = dyn_cast<ICmpInst>(br->getCondition());
+    if (!cmp) {
+        return false;
+    }
+    ICmpInst::Predicate pred = cmp->getPredicate();
+    if (cmp->getOperand(0) == inner.end && cmp->getOperand(1) == inner.start) {
+        pred = ICmpInst::getSwappedPredicate(pred);
+    } else if (cmp->getOperand(0) != inner.start || cmp->getOperand(1) != inner.end) {
+        return false;
+    }
+    enter = br->getSuccessor(0);
+    skip = br->getSuccessor(1);
+    if (pred != inner.pred && pred != ICmpInst::ICMP_NE) {
+        pred = ICmpInst::getInversePredicate(pred);
+        std::swap(enter, skip);
+    }
+    if (pred == ICmpInst::ICMP_NE) {
+        return SE.isKnownPredicate(ICmpInst::ICMP_SLE, SE.getSCEV(inner.start), SE.getSCEV(inner.end));
+    }
+    return pred == inner.pred;
+}
+
+// 判断两层循环是否完美嵌套：外层中不属于内层的部分只有从外层头部到内层preheader的一串基本块
+// （其中可以有内层循环的保护条件）和从内层出口到外层latch的一串基本块，其中只有无副作用的计算
+static bool isPerfect(const Level &outer, const Level &inner, ScalarEvolution &SE) {
+    Loop *O = outer.L;
+    Loop *L = inner.L;
+    if (O->getSubLoops().size() != 1) {
+        return false;
+    }
+
+    SmallPtrSet<BasicBlock *, 8> blocks;
+    BasicBlock *skip = nullptr;
+    BasicBlock *BB = O->getHeader();
+    while (true) {
+        if (L->contains(BB) || !O->contains(BB) || !blocks.insert(BB).second) {
+            return false;
+        }
+        if (BB == L->getLoopPreheader()) {
+            break;
+        }
+        auto *br = dyn_cast<BranchInst>(BB->getTerminator());
+        if (!br) {
+            return false;
+        }
+        if (br->isUnconditional()) {
+            BB = br->getSuccessor(0);
+            continue;
+        }
+        BasicBlock *enter;
+        if (skip || !isGuard(br, inner, SE, enter, skip)) {
+            return false;
+        }
+        BB = enter;
+    }
+
+    bool skipReached = !skip;
+    BB = L->getExitBlock();
+    while (true) {
+        if (L->contains(BB) || !O->contains(BB) || !blocks.insert(BB).second) {
+            return false;
+        }
+        skipReached = skipReached || BB == skip;
+        if (BB == O->getLoopLatch()) {
+            break;
+        }
+        auto *br = dyn_cast<BranchInst>(BB->getTerminator());
+        if (!br || br->isConditional()) {
+            return false;
+        }
+        BB = br->getSuccessor(0);
+    }
+    if (!skipReached || blocks.size() + L->getNumBlocks() != O->getNumBlocks()) {
+        return false;
+    }
+
+    // 这些计算在新的嵌套中会被复制到最内层
+    for (BasicBlock *block: blocks) {
+        for (Instruction &I: *block) {
+            if (isa<PHINode>(I) ? &I != outer.iv
+                                : !I.isTerminator() && (I.mayReadOrWriteMemory() || I.mayHaveSideEffects())) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// 地址在循环L上每次迭代的增量
+static std::optional<int64_t> getStride(const SCEV *S, const Loop *L, ScalarEvolution &SE) {
+    if (SE.isLoopInvariant(S, L)) {
+        return 0;
+    }
+    // 内层循环的AddRec在外，外层循环的在其起始值中
+    while (auto *AR = dyn_cast<SCEVAddRecExpr>(S)) {
+        const SCEV *step = AR->getStepRecurrence(SE);
+        if (AR->getLoop() == L) {
+            if (auto *constant = dyn_cast<SCEVConstant>(step)) {
+                return constant->getAPInt().getSExtValue();
+            }
+            return std::nullopt;
+        }
+        if (!SE.isLoopInvariant(step, L)) {
+            return std::nullopt;
+        }
+        S = AR->getStart();
+    }
+    if (SE.isLoopInvariant(S, L)) {
+        return 0;
+    }
+    return std::nullopt;
+}
+
+static uint64_t getObjectSize(const Value *pointer, const DataLayout &DL) {
+    const Value *object = getUnderlyingObject(pointer);
+    if (auto *GV = dyn_cast<GlobalVariable>(object)) {
+        return DL.getTypeAllocSize(GV->getValueType());
+    }
+    if (auto *alloca = dyn_cast<AllocaInst>(object)) {
+        if (auto size = alloca->getAllocationSizeInBits(DL)) {
+            return *size / 8;
+        }
+    }
+    return 0;
+}
+
+// 收集最内层循环中的访存，最内层只能有一个基本块，除load/store外不能有读写内存或有副作用的指令
+static bool collectAccesses(Nest &nest, ScalarEvolution &SE, const DataLayout &DL) {
+    BasicBlock *body = nest.levels.back().L->getHeader();
+    for (Instruction &I: *body) {
+        Value *pointer = getLoadStorePointerOperand(&I);
+        if (!pointer) {
+            if (I.mayReadOrWriteMemory() || I.mayHaveSideEffects()) {
+                return false;
+            }
+            continue;
+        }
+        if (isa<LoadInst>(I) ? !cast<LoadInst>(I).isSimple() : !cast<StoreInst>(I).isSimple()) {
+            return false;
+        }
+        Access access{&I, DL.getTypeStoreSize(getLoadStoreType(&I)), getObjectSize(pointer, DL), {}};
+        const SCEV *S = SE.getSCEV(pointer);
+        for (const Level &level: nest.levels) {
+            access.strides.push_back(getStride(S, level.L, SE));
+        }
+        nest.accesses.push_back(access);
+    }
+    return true;
+}
+
+// 计算访存之间的依赖方向，外层循环携带的依赖不受嵌套内循环顺序的影响
+static bool collectDependences(Nest &nest, DependenceInfo &DI) {
+    unsigned base = nest.levels.front().L->getLoopDepth();
+    for (size_t i = 0; i < nest.accesses.size(); i++) {
+        for (size_t j = i; j < nest.accesses.size(); j++) {
+            Instruction *src = nest.accesses[i].I;
+            Instruction *dst = nest.accesses[j].I;
+            if (!src->mayWriteToMemory() && !dst->mayWriteToMemory()) {
+                continue;
+            }
+            auto dep = DI.depends(src, dst, true);
+            if (!dep) {
+                continue;
+            }
+            if (dep->isConfused() || dep->getLevels() < base + nest.levels.size() - 1) {
+                return false;
+            }
+            bool carriedOutside = false;
+            for (unsigned level = 1; level < base; level++) {
+                carriedOutside = carriedOutside || !(dep->getDirection(level) & Dependence::DVEntry::EQ);
+            }
+            if (carriedOutside) {
+                continue;
+            }
+            Direction direction;
+            for (unsigned k = 0; k < nest.levels.size(); k++) {
+                direction.push_back(dep->getDirection(base + k));
+            }
+            nest.dependences.push_back(direction);
+        }
+    }
+    return true;
+}
+
+static std::optional<Nest> analyzeNest(Loop *innermost, ScalarEvolution &SE, DependenceInfo &DI,
+                                       const DataLayout &DL) {
+    if (!innermost->isInnermost() || innermost->getNumBlocks() != 1) {
+        return std::nullopt;
+    }
+    auto level = analyzeLevel(innermost, SE);
+    if (!level) {
+        return std::nullopt;
+    }
+    Nest nest;
+    nest.levels.push_back(*level);
+
+    // 向外扩展，要求各层循环的边界在整个嵌套中不变
+    while (nest.levels.size() < MaxNestDepth) {
+        Loop *parent = nest.levels.front().L->getParentLoop();
+        if (!parent) {
+            break;
+        }
+        auto outer = analyzeLevel(parent, SE);
+        if (!outer || !isPerfect(*outer, nest.levels.front(), SE) ||
+            llvm::any_of(nest.levels, [&](const Level &inner) {
+                return !parent->isLoopInvariant(inner.start) || !parent->isLoopInvariant(inner.end);
+            })) {
+            break;
+        }
+        nest.levels.insert(nest.levels.begin(), *outer);
+    }
+    if (nest.levels.size() < 2) {
+        return std::nullopt;
+    }
+
+    // 嵌套中的值不能在嵌套外使用
+    Loop *outer = nest.levels.front().L;
+    if (isa<PHINode>(outer->getExitBlock()->front())) {
+        return std::nullopt;
+    }
+    for (BasicBlock *BB: outer->blocks()) {
+        for (Instruction &I: *BB) {
+            for (User *user: I.users()) {
+                if (!outer->contains(cast<Instruction>(user))) {
+                    return std::nullopt;
+                }
+            }
+        }
+    }
+
+    if (!collectAccesses(nest, SE, DL) || !collectDependences(nest, DI)) {
+        return std::nullopt;
+    }
+    return nest;
+}
+
+// 枚举方向组合中的每个具体的方向向量（1为<，0为=，-1为>），
+// 第一个非零方向为负时依赖实际是从dst到src，取反后再检查
+static bool checkVectors(const Direction &direction, SmallVectorImpl<int> &vector,
+                         function_ref<bool(ArrayRef<int>)> check) {
+    if (vector.size() == direction.size()) {
+        SmallVector<int, MaxNestDepth> oriented(vector.begin(), vector.end());
+        auto first = llvm::find_if(oriented, [](int d) { return d != 0; });
+        if (first != oriented.end() && *first < 0) {
+            for (int &d: oriented) {
+                d = -d;
+            }
+        }
+        return check(oriented);
+    }
+    static const std::pair<unsigned, int> kinds[] = {
+            {Dependence::DVEntry::LT, 1},
+            {Dependence::DVEntry::EQ, 0},
+            {Dependence::DVEntry::GT, -1}
+    };
+    for (auto [bit, d]: kinds) {
+        if (!(direction[vector.size()] & bit)) {
+            continue;
+        }
+        vector.push_back(d);
+        bool legal = checkVectors(direction, vector, check);
+        vector.pop_back();
+        if (!legal) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 检查按order重排循环，并把位置carrier之后的循环分块、块循环移到carrier之前是否合法：
+// 依赖在新顺序中必须仍是正向的；不由carrier之前的循环携带的依赖，在分块的各层上不能有负方向
+static bool isLegal(const Nest &nest, ArrayRef<unsigned> order, unsigned carrier) {
+    auto check = [&](ArrayRef<int> vector) {
+        for (unsigned k = 0; k < carrier; k++) {
+            int d = vector[order[k]];
+            if (d != 0) {
+                return d > 0;
+            }
+        }
+        for (unsigned k = carrier; k < order.size(); k++) {
+            if (vector[order[k]] < 0) {
+                return false;
+            }
+        }
+        return true;
+    };
+    SmallVector<int, MaxNestDepth> vector;
+    return llvm::all_of(nest.dependences, [&](const Direction &direction) {
+        return checkVectors(direction, vector, check);
+    });
+}
+
+static bool isContiguous(const Access &access, unsigned level) {
+    const auto &stride = access.strides[level];
+    return stride && *stride != 0 && (uint64_t) std::abs(*stride) <= access.size;
+}
+
+// 循环作为最内层时每次迭代访问的cache行数的估计：不变的访存为0，连续的访存为1，跨行的访存为一行中的元素个数
+static unsigned getInnermostCost(const Nest &nest, unsigned level, const CPUCacheInfo &cache) {
+    unsigned cost = 0;
+    for (const Access &access: nest.accesses) {
+        const auto &stride = access.strides[level];
+        if (stride && *stride == 0) {
+            continue;
+        }
+        uint64_t bytes = stride ? std::min<uint64_t>(std::abs(*stride), cache.lineSize) : cache.lineSize;
+        cost += std::max<uint64_t>(bytes / access.size, 1);
+    }
+    return cost;
+}
+
+// 访存在某层循环上的迭代次数：常量迭代次数，或者由数组的大小推出：
+// 该维的长度为更高一维的步长（最高维为整个数组的大小）除以该维的步长
+static uint64_t estimateTripCount(const Nest &nest, const Access &access, unsigned level, ScalarEvolution &SE) {
+    if (unsigned tripCount = SE.getSmallConstantTripCount(nest.levels[level].L)) {
+        return tripCount;
+    }
+    uint64_t stride = std::abs(*access.strides[level]);
+    uint64_t outer = access.objectSize;
+    for (const auto &other: access.strides) {
+        uint64_t otherStride = other ? std::abs(*other) : 0;
+        if (otherStride > stride && (!outer || otherStride < outer)) {
+            outer = otherStride;
+        }
+    }
+    return outer ? std::max<uint64_t>(outer / stride, 1) : DefaultTripCount;
+}
+
+// 访存在order中位置carrier之后的各层循环中访问的数据量（字节），tripCount为块大小时即一个块的数据量
+static uint64_t getFootprint(const Access &access, ArrayRef<unsigned> order, unsigned carrier,
+                             function_ref<uint64_t(unsigned)> tripCount, const CPUCacheInfo &cache) {
+    uint64_t bytes = cache.lineSize;
+    for (unsigned k = carrier + 1; k < order.size(); k++) {
+        uint64_t stride = std::abs(*access.strides[order[k]]);
+        if (stride == 0) {
+            continue;
+        }
+        bytes *= tripCount(order[k]);
+        if (stride < cache.lineSize) {
+            bytes = std::max<uint64_t>(bytes * stride / cache.lineSize, 1);
+        }
+        bytes = std::min<uint64_t>(bytes, 1ull << 40);
+    }
+    return bytes;
+}
+
+// 选择分块的位置：从内向外找一层循环，其上有复用的访存（步长为0或小于一个cache行），
+// 该访存在最内层循环中不连续，并且在更内层循环中访问的数据量超过cache，复用时数据已被换出
+// 位置carrier之后该访存变化的循环被分块，块大小使一个块的数据量不超过cache的一半
+static std::optional<unsigned> chooseTiling(const Nest &nest, ArrayRef<unsigned> order, ScalarEvolution &SE,
+                                            const CPUCacheInfo &cache, SmallVectorImpl<bool> &tiled,
+                                            unsigned &tileSize) {
+    for (int carrier = (int) order.size() - 2; carrier >= 0; carrier--) {
+        for (const Access &access: nest.accesses) {
+            if (llvm::any_of(access.strides, [](const auto &stride) { return !stride; })) {
+                continue;
+            }
+            // 最内层连续的访问由硬件预取处理，分块反而缩短了向量化的最内层循环
+            if ((uint64_t) std::abs(*access.strides[order[carrier]]) >= cache.lineSize ||
+                isContiguous(access, order.back())) {
+                continue;
+            }
+            auto trips = [&](unsigned level) { return estimateTripCount(nest, access, level, SE); };
+            if (getFootprint(access, order, carrier, trips, cache) <= cache.L1Size) {
+                continue;
+            }
+
+            tileSize = TileSizeOption;
+            if (!tileSize) {
+                tileSize = MaxTileSize;
+                while (tileSize > MinTileSize &&
+                       getFootprint(access, order, carrier, [&](unsigned) { return tileSize; }, cache) >
+                       cache.L1Size / 2) {
+                    tileSize /= 2;
+                }
+            }
+            bool profitable = false;
+            tiled.assign(order.size(), false);
+            for (unsigned k = carrier + 1; k < order.size(); k++) {
+                if (*access.strides[order[k]] != 0) {
+                    tiled[order[k]] = true;
+                    profitable = profitable || trips(order[k]) > tileSize;
+                }
+            }
+            if (profitable) {
+                return carrier;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+// 按dims的顺序生成循环，最内层复制原嵌套中的计算
+static void emitLoops(const Nest &nest, ArrayRef<Dim> dims, unsigned tileSize, ArrayRef<Instruction *> body,
+                      BasicBlock *insertBefore, IRBuilder<> &builder, ValueToValueMapTy &VMap,
+                      SmallVectorImpl<Value *> &tiles) {
+    if (dims.empty()) {
+        SmallVector<Instruction *, 32> clones;
+        for (Instruction *I: body) {
+            Instruction *clone = I->clone();
+            clone->setName(I->getName());
+            builder.Insert(clone);
+            VMap[I] = clone;
+            clones.push_back(clone);
+        }
+        for (Instruction *clone: clones) {
+            RemapInstruction(clone, VMap, RF_NoModuleLevelChanges | RF_IgnoreMissingLocals);
+        }
+        return;
+    }
+
+    const Dim &dim = dims.front();
+    const Level &level = nest.levels[dim.level];
+    Type *type = level.iv->getType();
+    Value *lower = level.start;
+    Value *upper = level.end;
+    // 块内的循环：[tile, tile + min(end - tile, tileSize))
+    if (dim.kind == Dim::Point) {
+        lower = tiles[dim.level];
+        Value *remaining = builder.CreateSub(level.end, lower);
+        Value *size = builder.CreateBinaryIntrinsic(Intrinsic::umin, remaining, ConstantInt::get(type, tileSize));
+        upper = builder.CreateAdd(lower, size);
+    }
+
+    LLVMContext &C = builder.getContext();
+    Function *F = builder.GetInsertBlock()->getParent();
+    std::string name = level.iv->getName().str() + (dim.kind == Dim::Tile ? ".tile" : "");
+    auto *header = BasicBlock::Create(C, "nest.header", F, insertBefore);
+    auto *loopBody = BasicBlock::Create(C, "nest.body", F, insertBefore);
+    auto *exit = BasicBlock::Create(C, "nest.exit", F, insertBefore);
+    BasicBlock *entry = builder.GetInsertBlock();
+    builder.CreateBr(header);
+
+    builder.SetInsertPoint(header);
+    PHINode *iv = builder.CreatePHI(type, 2, name);
+    iv->addIncoming(lower, entry);
+    builder.CreateCondBr(builder.CreateICmp(level.pred, iv, upper), loopBody, exit);
+
+    builder.SetInsertPoint(loopBody);
+    if (dim.kind == Dim::Tile) {
+        tiles[dim.level] = iv;
+    } else {
+        VMap[level.iv] = iv;
+    }
+    emitLoops(nest, dims.drop_front(), tileSize, body, exit, builder, VMap, tiles);
+
+    // iv < upper <= end，加1不会溢出
+    Value *next;
+    if (dim.kind == Dim::Tile) {
+        next = builder.CreateAdd(iv, ConstantInt::get(type, tileSize), name + ".next");
+    } else {
+        bool isSigned = level.pred == ICmpInst::ICMP_SLT;
+        next = builder.CreateAdd(iv, ConstantInt::get(type, 1), name + ".next", !isSigned, isSigned);
+    }
+    iv->addIncoming(next, builder.GetInsertBlock());
+    builder.CreateBr(header);
+    builder.SetInsertPoint(exit);
+}
+
+// 用按dims生成的新嵌套替换原来的嵌套
+static void rebuildNest(const Nest &nest, ArrayRef<Dim> dims, unsigned tileSize, LoopInfo &LI) {
+    Loop *outer = nest.levels.front().L;
+    BasicBlock *preheader = outer->getLoopPreheader();
+    BasicBlock *exit = outer->getExitBlock();
+
+    // 按逆后序收集除phi和终结指令外的计算，定义在使用之前
+    LoopBlocksRPO RPO(outer);
+    RPO.perform(&LI);
+    SmallVector<Instruction *, 32> body;
+    for (BasicBlock *BB: RPO) {
+        for (Instruction &I: *BB) {
+            if (!isa<PHINode>(I) && !I.isTerminator()) {
+                body.push_back(&I);
+            }
+        }
+    }
+    SmallVector<BasicBlock *, 16> oldBlocks(outer->blocks());
+
+    preheader->getTerminator()->eraseFromParent();
+    IRBuilder<> builder(preheader);
+    ValueToValueMapTy VMap;
+    SmallVector<Value *, MaxNestDepth> tiles(nest.levels.size(), nullptr);
+    emitLoops(nest, dims, tileSize, body, exit, builder, VMap, tiles);
+    builder.CreateBr(exit);
+
+    for (BasicBlock *BB: oldBlocks) {
+        BB->dropAllReferences();
+    }
+    for (BasicBlock *BB: oldBlocks) {
+        BB->eraseFromParent();
+    }
+}
+
+static bool transformNest(const Nest &nest, const CPUCacheInfo &cache, LoopInfo &LI, ScalarEvolution &SE,
+                          OptimizationRemarkEmitter &ORE) {
+    unsigned depth = nest.levels.size();
+    SmallVector<unsigned, MaxNestDepth> order;
+    for (unsigned level = 0; level < depth; level++) {
+        order.push_back(level);
+    }
+
+    // 交换：有连续访问且代价最低的循环换到最内层，其余循环保持原来的相对顺序
+    unsigned best = depth - 1;
+    unsigned bestCost = getInnermostCost(nest, best, cache);
+    for (unsigned level = 0; level + 1 < depth; level++) {
+        unsigned cost = getInnermostCost(nest, level, cache);
+        bool contiguous = llvm::any_of(nest.accesses, [&](const Access &access) {
+            return isContiguous(access, level);
+        });
+        if (contiguous && cost < bestCost) {
+            best = level;
+            bestCost = cost;
+        }
+    }
+    bool interchanged = false;
+    if (best != depth - 1) {
+        SmallVector<unsigned, MaxNestDepth> newOrder;
+        for (unsigned level = 0; level < depth; level++) {
+            if (level != best) {
+                newOrder.push_back(level);
+            }
+        }
+        newOrder.push_back(best);
+        if (isLegal(nest, newOrder, depth)) {
+            order = newOrder;
+            interchanged = true;
+        }
+    }
+
+    // 分块
+    SmallVector<bool, MaxNestDepth> tiled;
+    unsigned tileSize = 0;
+    auto carrier = chooseTiling(nest, order, SE, cache, tiled, tileSize);
+    if (carrier && !isLegal(nest, order, *carrier)) {
+        carrier = std::nullopt;
+    }
+    if (!interchanged && !carrier) {
+        return false;
+    }
+
+    SmallVector<Dim, 2 * MaxNestDepth> dims;
+    unsigned split = carrier ? *carrier : depth;
+    for (unsigned k = 0; k < split; k++) {
+        dims.push_back({Dim::Whole, order[k]});
+    }
+    if (carrier) {
+        for (unsigned k = split + 1; k < depth; k++) {
+            if (tiled[order[k]]) {
+                dims.push_back({Dim::Tile, order[k]});
+            }
+        }
+        dims.push_back({Dim::Whole, order[split]});
+        for (unsigned k = split + 1; k < depth; k++) {
+            dims.push_back({tiled[order[k]] ? Dim::Point : Dim::Whole, order[k]});
+        }
+    }
+
+    Loop *innermost = nest.levels.back().L;
+    std::string orderText;
+    for (const Dim &dim: dims) {
+        orderText += (orderText.empty() ? "" : " ") + nest.levels[dim.level].iv->getName().str() +
+                     (dim.kind == Dim::Tile ? ".tile" : "");
+    }
+    log("loop-nest") << innermost->getHeader()->getParent()->getName().str() << ": " << orderText
+                     << (carrier ? ", tile size " + std::to_string(tileSize) : "") << std::endl;
+    ORE.emit([&]() {
+        OptimizationRemark remark(DEBUG_TYPE, carrier ? "Tiled" : "Interchanged",
+                                  innermost->getStartLoc(), innermost->getHeader());
+        remark << "loop nest reordered to (" << orderText << ")";
+        if (carrier) {
+            remark << " with tile size " << ore::NV("TileSize", tileSize);
+        }
+        return remark;
+    });
+    NumInterchanged += interchanged;
+    NumTiled += carrier.has_value();
+
+    rebuildNest(nest, dims, tileSize, LI);
+    return true;
+}
+
+PreservedAnalyses LoopNestPass::run(Function &F, FunctionAnalysisManager &FAM) {
+    const DataLayout &DL = F.getParent()->getDataLayout();
+    CPUCacheInfo cache = getCPUCacheInfo(targetMachine);
+    if (CacheSize) {
+        cache.L1Size = CacheSize;
+    }
+    bool changed = false;
+    // 已分析过的最内层循环；新生成的嵌套不是旋转后的形式，不会再被变换
+    SmallPtrSet<BasicBlock *, 8> visited;
+    for (unsigned count = 0; count < MaxNestsPerFunction; count++) {
+        auto &LI = FAM.getResult<LoopAnalysis>(F);
+        auto &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+        auto &DI = FAM.getResult<DependenceAnalysis>(F);
+        auto &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+
+        bool transformed = false;
+        for (Loop *L: LI.getLoopsInPreorder()) {
+            if (!L->isInnermost() || !visited.insert(L->getHeader()).second) {
+                continue;
+            }
+            auto nest = analyzeNest(L, SE, DI, DL);
+            if (nest && transformNest(*nest, cache, LI, SE, ORE)) {
+                transformed = true;
+                break;
+            }
+        }
+        if (!transformed) {
+            break;
+        }
+        changed = true;
+        FAM.invalidate(F, PreservedAnalyses::none());
+    }
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
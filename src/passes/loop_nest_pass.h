@@ -0,0 +1,25 @@
+#ifndef SYSY_COMPILER_PASSES_LOOP_NEST_PASS_H
+#define SYSY_COMPILER_PASSES_LOOP_NEST_PASS_H
+
+#include <llvm/IR/PassManager.h>
+#include <llvm/Target/TargetMachine.h>
+
+// 循环嵌套的交换与分块：处理最多三层的完美嵌套循环（除最内层外每层只有归纳变量和无副作用的计算），
+// 各层的边界在嵌套中不变（矩形的迭代空间）
+// 交换：按访存在各层循环上的步长估算代价，把有连续访问且代价最低的循环换到最内层
+// 分块：在最内层不连续的访存（如转置中的b[j][i]）在外层循环上有复用（步长为0或小于一个cache行），
+// 而内层循环访问的数据量超过cache时，对内层循环分块并把块循环移到外层，块大小由cache大小和访存的步长推出，
+// cache行大小和L1容量按-mcpu=选择的CPU查表
+// 数组的各维长度取自常量迭代次数，或由数组的大小和各维的步长推出
+// 两种变换都先由依赖分析检查合法性，然后按新的循环顺序重新生成整个嵌套
+// 需要在LICM之前进行，此时累加到数组元素上的计算还没有被提升为寄存器中的归约，嵌套仍是完美的
+class LoopNestPass : public llvm::PassInfoMixin<LoopNestPass> {
+    const llvm::TargetMachine &targetMachine;
+
+public:
+    explicit LoopNestPass(const llvm::TargetMachine &targetMachine) : targetMachine(targetMachine) {}
+
+    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+};
+
+#endif //SYSY_COMPILER_PASSES_LOOP_NEST_PASS_H
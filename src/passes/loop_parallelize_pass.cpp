@@ -0,0 +1,490 @@
+#include <optional>
+#include <llvm/ADT/SetVector.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/DependenceAnalysis.h>
+#include <llvm/Analysis/IVDescriptors.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/LoopSimplify.h>
+#include <llvm/Transforms/Utils/LoopUtils.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+#include "log.h"
+#include "loop_parallelize_pass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "loop-parallelize"
+
+STATISTIC(NumParallelized, "Number of loops parallelized");
+STATISTIC(NumReductions, "Number of reductions in parallelized loops");
+
+static cl::opt<bool> EnableAutoParallel(
+        "auto-parallel", cl::init(false),
+        cl::desc("Parallelize loops without loop-carried dependences (needs -lpthread)"));
+
+// 一次fork-join的开销约为数万条指令，循环的总工作量低于该值时不值得并行
+static cl::opt<unsigned> MinParallelWork(
+        "auto-parallel-min-work", cl::init(50000), cl::Hidden,
+        cl::desc("Min estimated instructions executed by a loop to run it in parallel"));
+
+// 与runtime_lib/sylib.h中的_SYSY_MAX_THREADS保持一致，每个线程有一个归约的部分结果
+static constexpr unsigned MaxThreads = 4;
+
+// 无法求出内层循环的迭代次数时假定的值
+static constexpr unsigned DefaultInnerTripCount = 16;
+
+namespace {
+
+    struct Reduction {
+        PHINode *phi;
+        RecurrenceDescriptor desc;
+        // 循环出口处使用归约结果的LCSSA phi，结果未被使用时为nullptr
+        PHINode *exitPhi = nullptr;
+    };
+
+    // 可以并行化的循环：for (iv = begin; iv < end; iv++)，迭代之间没有依赖
+    struct ParallelLoop {
+        Loop *L;
+        PHINode *iv;
+        Value *begin;
+        Value *end;
+        // 循环条件中end所在的操作数位置
+        unsigned endOperand;
+        SmallVector<Reduction, 2> reductions;
+        // 循环中使用的、在循环外定义的值，通过上下文结构体传给提取出的函数
+        SmallSetVector<Value *, 8> liveIns;
+        unsigned threshold;
+    };
+
+} // namespace
+
+// 估算循环一次迭代执行的指令数，内层循环按迭代次数加权
+static uint64_t estimateIterationCost(Loop *L, LoopInfo &LI, ScalarEvolution &SE) {
+    uint64_t cost = 0;
+    for (BasicBlock *BB: L->blocks()) {
+        if (LI.getLoopFor(BB) == L) {
+            cost += BB->size();
+        }
+    }
+    for (Loop *subLoop: L->getSubLoops()) {
+        unsigned tripCount = SE.getSmallConstantTripCount(subLoop);
+        cost += estimateIterationCost(subLoop, LI, SE) * (tripCount ? tripCount : DefaultInnerTripCount);
+    }
+    return cost;
+}
+
+// 判断循环中任意两个访存之间是否都不存在由该循环携带的依赖
+static bool hasNoCarriedDependence(Loop *L, ArrayRef<Instruction *> memInsts, DependenceInfo &DI) {
+    unsigned level = L->getLoopDepth();
+    for (size_t i = 0; i < memInsts.size(); i++) {
+        for (size_t j = i; j < memInsts.size(); j++) {
+            Instruction *src = memInsts[i];
+            Instruction *dst = memInsts[j];
+            if (!src->mayWriteToMemory() && !dst->mayWriteToMemory()) {
+                continue;
+            }
+            auto dep = DI.depends(src, dst, true);
+            if (!dep) {
+                continue;
+            }
+            if (dep->isConfused() || level > dep->getLevels() ||
+                dep->getDirection(level) != Dependence::DVEntry::EQ) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static std::optional<ParallelLoop> analyzeLoop(Loop *L, LoopInfo &LI, ScalarEvolution &SE,
+                                               DependenceInfo &DI, DominatorTree &DT, AAResults &AA) {
+    if (!L->isLoopSimplifyForm() || !L->isRotatedForm() || !L->isLCSSAForm(DT)) {
+        return std::nullopt;
+    }
+    BasicBlock *latch = L->getLoopLatch();
+    BasicBlock *exit = L->getExitBlock();
+    if (!exit || L->getExitingBlock() != latch ||
+        !isa<BranchInst>(L->getLoopPreheader()->getTerminator())) {
+        return std::nullopt;
+    }
+
+    // 归纳变量：从begin开始每次加1，直到不小于end
+    PHINode *iv = L->getInductionVariable(SE);
+    if (!iv || !iv->getType()->isIntegerTy(32)) {
+        return std::nullopt;
+    }
+    auto bounds = L->getBounds(SE);
+    if (!bounds) {
+        return std::nullopt;
+    }
+    auto *step = dyn_cast_or_null<ConstantInt>(bounds->getStepValue());
+    ICmpInst *latchCmp = L->getLatchCmpInst();
+    // 边界为常量时InstCombine会把i < n改写为无符号比较，两端都非负时与有符号比较相同
+    ICmpInst::Predicate pred = bounds->getCanonicalPredicate();
+    if (pred == ICmpInst::ICMP_ULT && SE.isKnownNonNegative(SE.getSCEV(&bounds->getInitialIVValue())) &&
+        SE.isKnownNonNegative(SE.getSCEV(&bounds->getFinalIVValue()))) {
+        pred = ICmpInst::ICMP_SLT;
+    }
+    if (!step || !step->isOne() || !latchCmp || pred != ICmpInst::ICMP_SLT ||
+        !L->isLoopInvariant(&bounds->getFinalIVValue())) {
+        return std::nullopt;
+    }
+    unsigned endOperand;
+    if (latchCmp->getOperand(0) == &bounds->getStepInst()) {
+        endOperand = 1;
+    } else if (latchCmp->getOperand(1) == &bounds->getStepInst()) {
+        endOperand = 0;
+    } else {
+        return std::nullopt;
+    }
+
+    ParallelLoop PL{L, iv, &bounds->getInitialIVValue(), &bounds->getFinalIVValue(), endOperand};
+
+    // 除归纳变量外，循环头的phi只能是整数归约
+    for (PHINode &phi: L->getHeader()->phis()) {
+        if (&phi == iv) {
+            continue;
+        }
+        RecurrenceDescriptor desc;
+        if (!RecurrenceDescriptor::isReductionPHI(&phi, L, desc) ||
+            !RecurrenceDescriptor::isIntegerRecurrenceKind(desc.getRecurrenceKind()) ||
+            RecurrenceDescriptor::isSelectCmpRecurrenceKind(desc.getRecurrenceKind())) {
+            return std::nullopt;
+        }
+        PL.reductions.push_back({&phi, desc});
+    }
+
+    // 循环外只能使用归约的结果
+    for (PHINode &exitPhi: exit->phis()) {
+        Value *value = exitPhi.getIncomingValueForBlock(latch);
+        auto it = llvm::find_if(PL.reductions, [&](const Reduction &reduction) {
+            return reduction.desc.getLoopExitInstr() == value;
+        });
+        if (it == PL.reductions.end() || it->exitPhi) {
+            return std::nullopt;
+        }
+        it->exitPhi = &exitPhi;
+    }
+
+    // 循环中不能有写内存的调用（包括输入输出），访存之间不能有跨迭代的依赖
+    SmallVector<Instruction *, 16> memInsts;
+    SmallVector<CallBase *, 4> readCalls;
+    for (BasicBlock *BB: L->blocks()) {
+        for (Instruction &I: *BB) {
+            if (auto *CB = dyn_cast<CallBase>(&I)) {
+                if (!CB->onlyReadsMemory() || !CB->willReturn()) {
+                    return std::nullopt;
+                }
+                if (!CB->doesNotAccessMemory()) {
+                    readCalls.push_back(CB);
+                }
+            } else if (isa<AllocaInst>(&I)) {
+                return std::nullopt;
+            } else if (auto *load = dyn_cast<LoadInst>(&I)) {
+                if (!load->isSimple()) {
+                    return std::nullopt;
+                }
+                memInsts.push_back(load);
+            } else if (auto *store = dyn_cast<StoreInst>(&I)) {
+                if (!store->isSimple()) {
+                    return std::nullopt;
+                }
+                memInsts.push_back(store);
+            } else if (I.mayWriteToMemory()) {
+                return std::nullopt;
+            }
+
+            for (Value *op: I.operands()) {
+                auto *opInst = dyn_cast<Instruction>(op);
+                if ((opInst && !L->contains(opInst)) || isa<Argument>(op)) {
+                    PL.liveIns.insert(op);
+                }
+            }
+        }
+    }
+    if (!hasNoCarriedDependence(L, memInsts, DI)) {
+        return std::nullopt;
+    }
+    // 依赖分析看不到被调函数中的访存：只读的调用不能读循环中写的内存，
+    // 否则可能读到其他线程中其他迭代写入（或尚未写入）的值
+    for (CallBase *CB: readCalls) {
+        for (Instruction *I: memInsts) {
+            if (isa<StoreInst>(I) && isRefSet(AA.getModRefInfo(CB, MemoryLocation::get(cast<StoreInst>(I))))) {
+                return std::nullopt;
+            }
+        }
+    }
+
+    uint64_t cost = std::max<uint64_t>(estimateIterationCost(L, LI, SE), 1);
+    PL.threshold = std::max<uint64_t>((MinParallelWork + cost - 1) / cost, 2 * MaxThreads);
+    return PL;
+}
+
+// 生成循环体函数：void body(i32 begin, i32 end, i8 *ctx, i32 thread)
+// 在[begin, end)上执行原循环，归约的部分结果写入上下文中该线程的位置
+static Function *outlineLoop(ParallelLoop &PL, StructType *ctxType) {
+    Loop *L = PL.L;
+    Function *F = L->getHeader()->getParent();
+    Module *M = F->getParent();
+    LLVMContext &C = M->getContext();
+    IRBuilder<> builder(C);
+
+    auto *bodyType = FunctionType::get(
+            builder.getVoidTy(),
+            {builder.getInt32Ty(), builder.getInt32Ty(), builder.getInt8PtrTy(), builder.getInt32Ty()},
+            false
+    );
+    Function *body = Function::Create(bodyType, GlobalValue::InternalLinkage, F->getName() + ".par", M);
+    body->addFnAttr(Attribute::NoUnwind);
+    Argument *begin = body->getArg(0);
+    Argument *end = body->getArg(1);
+    Argument *thread = body->getArg(3);
+    begin->setName("begin");
+    end->setName("end");
+    body->getArg(2)->setName("ctx");
+    thread->setName("thread");
+
+    // 入口：从上下文中取出循环使用的外部值
+    ValueToValueMapTy VMap;
+    auto *entry = BasicBlock::Create(C, "entry", body);
+    builder.SetInsertPoint(entry);
+    Value *ctx = builder.CreateBitCast(body->getArg(2), ctxType->getPointerTo());
+    for (unsigned i = 0; i < PL.liveIns.size(); i++) {
+        Value *liveIn = PL.liveIns[i];
+        VMap[liveIn] = builder.CreateLoad(liveIn->getType(), builder.CreateStructGEP(ctxType, ctx, i),
+                                          liveIn->getName());
+    }
+    VMap[L->getLoopPreheader()] = entry;
+
+    // 复制循环
+    SmallVector<BasicBlock *, 16> blocks;
+    for (BasicBlock *BB: L->blocks()) {
+        BasicBlock *newBB = CloneBasicBlock(BB, VMap, ".par", body);
+        VMap[BB] = newBB;
+        blocks.push_back(newBB);
+    }
+    auto *exit = BasicBlock::Create(C, "exit", body);
+    auto *ret = BasicBlock::Create(C, "ret", body);
+    VMap[L->getExitBlock()] = exit;
+    remapInstructionsInBlocks(blocks, VMap);
+
+    auto *header = cast<BasicBlock>(VMap[L->getHeader()]);
+    builder.CreateCondBr(builder.CreateICmpSLT(begin, end), header, ret);
+
+    // 归纳变量从begin开始，到end结束；归约从单位元开始
+    cast<PHINode>(VMap[PL.iv])->setIncomingValueForBlock(entry, begin);
+    cast<ICmpInst>(VMap[PL.L->getLatchCmpInst()])->setOperand(PL.endOperand, end);
+    for (Reduction &reduction: PL.reductions) {
+        auto *phi = cast<PHINode>(VMap[reduction.phi]);
+        phi->setIncomingValueForBlock(entry, reduction.desc.getRecurrenceIdentity(
+                reduction.desc.getRecurrenceKind(), phi->getType(), FastMathFlags()));
+
+        // 部分和可能溢出而总和不溢出，去掉归约运算上的nsw等标记
+        for (Instruction *I: reduction.desc.getReductionOpChain(reduction.phi, L)) {
+            cast<Instruction>(VMap[I])->dropPoisonGeneratingFlags();
+        }
+        cast<Instruction>(VMap[reduction.desc.getLoopExitInstr()])->dropPoisonGeneratingFlags();
+    }
+
+    // 出口：写回归约的部分结果
+    builder.SetInsertPoint(exit);
+    for (unsigned i = 0; i < PL.reductions.size(); i++) {
+        Reduction &reduction = PL.reductions[i];
+        if (!reduction.exitPhi) {
+            continue;
+        }
+        Value *slot = builder.CreateInBoundsGEP(
+                ctxType, ctx, {builder.getInt32(0), builder.getInt32(PL.liveIns.size() + i), thread});
+        builder.CreateStore(VMap[reduction.desc.getLoopExitInstr()], slot);
+    }
+    builder.CreateBr(ret);
+
+    builder.SetInsertPoint(ret);
+    builder.CreateRetVoid();
+    return body;
+}
+
+// 在循环前插入并行版本：迭代次数足够多时调用运行时库并行执行，之后合并归约结果并跳到循环出口
+static void parallelize(ParallelLoop &PL, FunctionCallee parallelFor) {
+    Loop *L = PL.L;
+    BasicBlock *preheader = L->getLoopPreheader();
+    BasicBlock *header = L->getHeader();
+    BasicBlock *exit = L->getExitBlock();
+    Function *F = header->getParent();
+    LLVMContext &C = F->getContext();
+    IRBuilder<> builder(C);
+
+    // 上下文结构体：循环使用的外部值，以及每个归约在每个线程上的部分结果
+    SmallVector<Type *, 8> fields;
+    for (Value *liveIn: PL.liveIns) {
+        fields.push_back(liveIn->getType());
+    }
+    for (Reduction &reduction: PL.reductions) {
+        fields.push_back(ArrayType::get(reduction.phi->getType(), MaxThreads));
+    }
+    StructType *ctxType = StructType::create(C, fields, F->getName().str() + ".par.ctx");
+    Function *body = outlineLoop(PL, ctxType);
+
+    builder.SetInsertPoint(&F->getEntryBlock(), F->getEntryBlock().begin());
+    AllocaInst *ctx = builder.CreateAlloca(ctxType, nullptr, "par.ctx");
+
+    // 迭代次数少于阈值时执行原来的串行循环
+    auto *parallelBB = BasicBlock::Create(C, "par", F, header);
+    preheader->getTerminator()->eraseFromParent();
+    builder.SetInsertPoint(preheader);
+    Value *tripCount = builder.CreateSub(PL.end, PL.begin, "par.trip");
+    Value *small = builder.CreateICmpSLT(tripCount, builder.getInt32(PL.threshold), "par.small");
+    builder.CreateCondBr(small, header, parallelBB);
+
+    builder.SetInsertPoint(parallelBB);
+    for (unsigned i = 0; i < PL.liveIns.size(); i++) {
+        builder.CreateStore(PL.liveIns[i], builder.CreateStructGEP(ctxType, ctx, i));
+    }
+    for (unsigned i = 0; i < PL.reductions.size(); i++) {
+        Reduction &reduction = PL.reductions[i];
+        if (!reduction.exitPhi) {
+            continue;
+        }
+        Value *identity = reduction.desc.getRecurrenceIdentity(
+                reduction.desc.getRecurrenceKind(), reduction.phi->getType(), FastMathFlags());
+        for (unsigned t = 0; t < MaxThreads; t++) {
+            builder.CreateStore(identity, builder.CreateInBoundsGEP(
+                    ctxType, ctx, {builder.getInt32(0), builder.getInt32(PL.liveIns.size() + i), builder.getInt32(t)}));
+        }
+    }
+    builder.CreateCall(parallelFor, {body, PL.begin, PL.end, builder.CreateBitCast(ctx, builder.getInt8PtrTy())});
+
+    // 将初值与各线程的部分结果合并
+    for (unsigned i = 0; i < PL.reductions.size(); i++) {
+        Reduction &reduction = PL.reductions[i];
+        if (!reduction.exitPhi) {
+            continue;
+        }
+        RecurKind kind = reduction.desc.getRecurrenceKind();
+        Value *result = reduction.desc.getRecurrenceStartValue();
+        for (unsigned t = 0; t < MaxThreads; t++) {
+            Value *partial = builder.CreateLoad(reduction.phi->getType(), builder.CreateInBoundsGEP(
+                    ctxType, ctx, {builder.getInt32(0), builder.getInt32(PL.liveIns.size() + i), builder.getInt32(t)}));
+            if (RecurrenceDescriptor::isMinMaxRecurrenceKind(kind)) {
+                result = createMinMaxOp(builder, kind, result, partial);
+            } else {
+                result = builder.CreateBinOp(
+                        (Instruction::BinaryOps) RecurrenceDescriptor::getOpcode(kind), result, partial);
+            }
+        }
+        reduction.exitPhi->addIncoming(result, parallelBB);
+        NumReductions++;
+    }
+    builder.CreateBr(exit);
+}
+
+// 之前推导的nosync在调用_sysy_parallel_for（创建线程并等待）的函数及其所有调用者上不再成立
+static void dropNoSync(Function *parallelFor) {
+    SmallVector<Function *, 8> worklist{parallelFor};
+    SmallPtrSet<Function *, 8> visited{parallelFor};
+    while (!worklist.empty()) {
+        Function *callee = worklist.pop_back_val();
+        for (User *U: callee->users()) {
+            if (auto *CB = dyn_cast<CallBase>(U)) {
+                Function *caller = CB->getFunction();
+                CB->removeFnAttr(Attribute::NoSync);
+                if (visited.insert(caller).second) {
+                    caller->removeFnAttr(Attribute::NoSync);
+                    worklist.push_back(caller);
+                }
+            }
+        }
+    }
+}
+
+PreservedAnalyses LoopParallelizePass::run(Module &M, ModuleAnalysisManager &AM) {
+    if (!EnableAutoParallel) {
+        return PreservedAnalyses::all();
+    }
+
+    LLVMContext &C = M.getContext();
+    auto *bodyType = FunctionType::get(
+            Type::getVoidTy(C),
+            {Type::getInt32Ty(C), Type::getInt32Ty(C), Type::getInt8PtrTy(C), Type::getInt32Ty(C)},
+            false
+    );
+    FunctionCallee parallelFor = M.getOrInsertFunction(
+            "_sysy_parallel_for",
+            Type::getVoidTy(C),
+            bodyType->getPointerTo(), Type::getInt32Ty(C), Type::getInt32Ty(C), Type::getInt8PtrTy(C)
+    );
+
+    auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    SmallVector<Function *, 8> functions;
+    for (Function &F: M) {
+        if (!F.isDeclaration()) {
+            functions.push_back(&F);
+        }
+    }
+
+    bool changed = false;
+    for (Function *F: functions) {
+        // 每次变换后重新计算分析结果；已分析过的循环（包括保留为串行版本的循环）不再分析，
+        // 但仍会检查其内层循环，外层迭代次数少时内层循环仍可以并行
+        SmallPtrSet<BasicBlock *, 8> visited;
+        while (true) {
+            auto &LI = FAM.getResult<LoopAnalysis>(*F);
+            auto &SE = FAM.getResult<ScalarEvolutionAnalysis>(*F);
+            auto &DT = FAM.getResult<DominatorTreeAnalysis>(*F);
+            auto &AC = FAM.getResult<AssumptionAnalysis>(*F);
+
+            // 之前的SimplifyCFG可能删除了preheader、合并了出口块，先恢复循环的规范形式
+            for (Loop *L: LI.getLoopsInPreorder()) {
+                if (!L->isLoopSimplifyForm()) {
+                    changed |= simplifyLoop(L, &DT, &LI, &SE, &AC, nullptr, false);
+                }
+            }
+            for (Loop *L: LI) {
+                changed |= formLCSSARecursively(*L, DT, &LI, &SE);
+            }
+            auto &DI = FAM.getResult<DependenceAnalysis>(*F);
+            auto &AA = FAM.getResult<AAManager>(*F);
+
+            // 由外向内寻找可并行的循环，外层循环并行的粒度更大
+            std::optional<ParallelLoop> PL;
+            SmallVector<Loop *, 8> worklist(LI.begin(), LI.end());
+            while (!PL && !worklist.empty()) {
+                Loop *L = worklist.pop_back_val();
+                if (visited.insert(L->getHeader()).second) {
+                    PL = analyzeLoop(L, LI, SE, DI, DT, AA);
+                }
+                if (!PL) {
+                    worklist.append(L->begin(), L->end());
+                }
+            }
+            if (!PL) {
+                break;
+            }
+
+            log("parallelize") << F->getName().str() << ": loop " << PL->L->getHeader()->getName().str()
+                               << ", " << PL->reductions.size() << " reductions, threshold "
+                               << PL->threshold << std::endl;
+            parallelize(*PL, parallelFor);
+            FAM.invalidate(*F, PreservedAnalyses::none());
+            NumParallelized++;
+            changed = true;
+        }
+    }
+
+    auto *parallelForFunction = cast<Function>(parallelFor.getCallee());
+    if (parallelForFunction->use_empty()) {
+        parallelForFunction->eraseFromParent();
+    } else {
+        dropNoSync(parallelForFunction);
+    }
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
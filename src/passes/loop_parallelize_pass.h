@@ -0,0 +1,15 @@
+#ifndef SYSY_COMPILER_PASSES_LOOP_PARALLELIZE_PASS_H
+#define SYSY_COMPILER_PASSES_LOOP_PARALLELIZE_PASS_H
+
+#include <llvm/IR/PassManager.h>
+
+// 自动并行化：没有跨迭代依赖（或只有整数求和、最值等归约）的循环被提取为单独的函数，
+// 迭代区间通过运行时库的_sysy_parallel_for按静态分块分配给线程池中的各个线程执行
+// 迭代次数小于阈值时仍执行原来的串行循环，阈值由循环体的规模估算
+// 运行时库需要链接pthread，因此默认关闭，使用 -mllvm -auto-parallel 开启
+class LoopParallelizePass : public llvm::PassInfoMixin<LoopParallelizePass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+};
+
+#endif //SYSY_COMPILER_PASSES_LOOP_PARALLELIZE_PASS_H
@@ -0,0 +1,307 @@
+#include <optional>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/CodeMetrics.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/Local.h>
+#include <llvm/Transforms/Utils/LoopPeel.h>
+#include <llvm/Transforms/Utils/LoopSimplify.h>
+#include <llvm/Transforms/Utils/LoopUtils.h>
+#include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
+#include <llvm/Transforms/Utils/UnrollLoop.h>
+#include "log.h"
+#include "loop_peel_pass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "sysy-peel"
+
+STATISTIC(NumPeeledFirst, "Number of loops with leading iterations peeled");
+STATISTIC(NumPeeledLast, "Number of loops with the last iteration peeled");
+STATISTIC(NumComparesFolded, "Number of compares folded after peeling");
+
+// 剥离前几次迭代时，剥离的迭代与循环本身的总规模不超过阈值；剥离最后一次迭代时循环体不超过阈值的一半
+static cl::opt<unsigned> PeelThreshold(
+        "sysy-peel-threshold", cl::init(120), cl::Hidden,
+        cl::desc("Max number of instructions of a loop and its peeled iterations"));
+
+static cl::opt<unsigned> MaxPeelCount(
+        "sysy-peel-max-count", cl::init(2), cl::Hidden,
+        cl::desc("Max number of leading iterations to peel"));
+
+namespace {
+    // 只在最后一次迭代中成立（或不成立）的相等比较
+    struct LastIterationCompare {
+        ICmpInst *cmp;
+        Value *iv;          // 比较的一侧，是循环的仿射归纳变量
+        Value *last;        // 比较的另一侧，循环不变，等于归纳变量在最后一次迭代的值
+        const SCEVAddRecExpr *AR;
+    };
+}
+
+// 剥离后，循环中由SCEV可以确定结果的比较折叠为常量
+static bool foldKnownCompares(Loop *L, ScalarEvolution &SE) {
+    bool changed = false;
+    for (BasicBlock *BB: L->blocks()) {
+        for (Instruction &I: make_early_inc_range(*BB)) {
+            auto *cmp = dyn_cast<ICmpInst>(&I);
+            if (!cmp || !SE.isSCEVable(cmp->getOperand(0)->getType())) {
+                continue;
+            }
+            const SCEV *lhs = SE.getSCEV(cmp->getOperand(0));
+            const SCEV *rhs = SE.getSCEV(cmp->getOperand(1));
+            if (!isa<SCEVAddRecExpr>(lhs) && !isa<SCEVAddRecExpr>(rhs)) {
+                continue;
+            }
+            std::optional<bool> known;
+            if (SE.isKnownPredicate(cmp->getPredicate(), lhs, rhs)) {
+                known = true;
+            } else if (SE.isKnownPredicate(cmp->getInversePredicate(), lhs, rhs)) {
+                known = false;
+            }
+            if (known) {
+                cmp->replaceAllUsesWith(ConstantInt::getBool(cmp->getType(), *known));
+                RecursivelyDeleteTriviallyDeadInstructions(cmp);
+                NumComparesFolded++;
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+// 循环之前的GVN做了部分冗余消除：一个分支中已有i + 1（如a[i + 1]的下标）时，在另一个分支中补上i + 1，
+// 归纳变量的递增变为两者的phi，SCEV无法分析；这里把各入边值相同的运算重新合并到phi所在的块中
+static bool mergeIdenticalIncomingOps(Loop *L, DominatorTree &DT) {
+    bool changed = false;
+    for (BasicBlock *BB: L->blocks()) {
+        if (BB == L->getHeader()) {
+            continue;
+        }
+        for (PHINode &phi: make_early_inc_range(BB->phis())) {
+            auto *first = dyn_cast<BinaryOperator>(phi.getIncomingValue(0));
+            if (!first || !all_of(phi.incoming_values(), [&](Value *V) {
+                auto *op = dyn_cast<Instruction>(V);
+                return op && op->isIdenticalToWhenDefined(first);
+            }) || !all_of(first->operands(), [&](Value *V) {
+                auto *op = dyn_cast<Instruction>(V);
+                return !op || DT.dominates(op, BB);
+            })) {
+                continue;
+            }
+            Instruction *merged = first->clone();
+            for (Value *V: phi.incoming_values()) {
+                merged->andIRFlags(V);
+            }
+            merged->insertBefore(&*BB->getFirstInsertionPt());
+            merged->takeName(&phi);
+            phi.replaceAllUsesWith(merged);
+            phi.eraseFromParent();
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// 查找只在最后一次迭代中结果不同的相等比较，要求循环只有latch一个出口，迭代次数可以由SCEV求出
+static std::optional<LastIterationCompare> findLastIterationCompare(Loop *L, ScalarEvolution &SE,
+                                                                    DominatorTree &DT) {
+    BasicBlock *latch = L->getLoopLatch();
+    if (L->getExitingBlock() != latch || !isa<BranchInst>(latch->getTerminator())) {
+        return std::nullopt;
+    }
+    const SCEV *BTC = SE.getBackedgeTakenCount(L);
+    if (isa<SCEVCouldNotCompute>(BTC)) {
+        return std::nullopt;
+    }
+
+    for (BasicBlock *BB: L->blocks()) {
+        auto *br = dyn_cast<BranchInst>(BB->getTerminator());
+        auto *cmp = br && br->isConditional() && BB != latch ? dyn_cast<ICmpInst>(br->getCondition()) : nullptr;
+        if (!cmp || !cmp->isEquality() || !cmp->getOperand(0)->getType()->isIntegerTy()) {
+            continue;
+        }
+        for (unsigned i = 0; i < 2; i++) {
+            Value *iv = cmp->getOperand(i), *last = cmp->getOperand(1 - i);
+            auto *ivInst = dyn_cast<Instruction>(iv);
+            auto *AR = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(iv));
+            // 归纳变量不回绕时只在一次迭代中等于last；在latch中还要用它计算下一次迭代的值
+            if (!ivInst || !L->isLoopInvariant(last) || !AR || AR->getLoop() != L || !AR->isAffine() ||
+                !AR->hasNoSelfWrap() || !isa<SCEVConstant>(AR->getStepRecurrence(SE)) ||
+                !DT.dominates(ivInst->getParent(), latch)) {
+                continue;
+            }
+            const SCEV *lastValue = AR->evaluateAtIteration(SE.getTruncateOrZeroExtend(BTC, AR->getType()), SE);
+            // 迭代次数中可能带有循环入口条件（如n > 0）的信息，两侧都按入口条件化简后比较
+            if (SE.applyLoopGuards(lastValue, L) == SE.applyLoopGuards(SE.getSCEV(last), L)) {
+                return LastIterationCompare{cmp, iv, last, AR};
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+// 剥离最后一次迭代：
+// 原来的循环执行到归纳变量的下一个值等于last为止，比较恒为不相等；
+// 之后执行复制出的一份循环体，其中header的phi取原循环最后的值，比较恒为相等；
+// 只有一次迭代时跳过原循环，直接执行复制的循环体
+static void peelLastIteration(Loop *L, const LastIterationCompare &LC, LoopInfo &LI,
+                              DominatorTree &DT, ScalarEvolution &SE) {
+    BasicBlock *header = L->getHeader();
+    BasicBlock *latch = L->getLoopLatch();
+    BasicBlock *exit = L->getExitBlock();
+    Function *F = header->getParent();
+    Loop *parent = L->getParentLoop();
+    SE.forgetTopmostLoop(L);
+
+    // 复制循环体，作为最后一次迭代
+    ValueToValueMapTy VMap;
+    SmallVector<BasicBlock *, 8> clones;
+    for (BasicBlock *BB: L->blocks()) {
+        BasicBlock *clone = CloneBasicBlock(BB, VMap, ".last", F);
+        clone->moveBefore(exit);
+        VMap[BB] = clone;
+        clones.push_back(clone);
+    }
+    remapInstructionsInBlocks(clones, VMap);
+    auto *cloneHeader = cast<BasicBlock>(VMap[header]);
+    auto *cloneLatch = cast<BasicBlock>(VMap[latch]);
+    auto *cloneCmp = cast<ICmpInst>(VMap[LC.cmp]);
+    bool isEq = LC.cmp->getPredicate() == ICmpInst::ICMP_EQ;
+    cloneCmp->replaceAllUsesWith(ConstantInt::getBool(cloneCmp->getType(), isEq));
+    cloneCmp->eraseFromParent();
+    cloneLatch->getTerminator()->eraseFromParent();
+    BranchInst::Create(exit, cloneLatch);
+
+    // 只有一次迭代时从preheader直接进入复制的循环体
+    BasicBlock *guard = L->getLoopPreheader();
+    BasicBlock *preheader = SplitEdge(guard, header, &DT, &LI);
+    IRBuilder<> builder(guard->getTerminator());
+    SCEVExpander expander(SE, F->getParent()->getDataLayout(), "peel");
+    Value *start = expander.expandCodeFor(LC.AR->getStart(), LC.iv->getType(), guard->getTerminator());
+    Value *single = builder.CreateICmpEQ(start, LC.last, "peel.single");
+    builder.CreateCondBr(single, cloneHeader, preheader);
+    guard->getTerminator()->eraseFromParent();
+
+    // 原循环的出口改为进入复制的循环体，header的phi的值经过出口块中的LCSSA phi传入
+    BasicBlock *lastPreheader = BasicBlock::Create(F->getContext(), header->getName() + ".last.pre", F, cloneHeader);
+    BranchInst::Create(cloneHeader, lastPreheader);
+    for (PHINode &phi: header->phis()) {
+        auto *clonePhi = cast<PHINode>(VMap[&phi]);
+        Value *latchValue = phi.getIncomingValueForBlock(latch);
+        if (auto *inst = dyn_cast<Instruction>(latchValue); inst && L->contains(inst)) {
+            PHINode *lcssa = PHINode::Create(phi.getType(), 1, phi.getName() + ".lcssa", &lastPreheader->front());
+            lcssa->addIncoming(latchValue, latch);
+            latchValue = lcssa;
+        }
+        clonePhi->removeIncomingValue(cloneLatch);
+        clonePhi->setIncomingBlock(0, lastPreheader);
+        clonePhi->setIncomingValue(0, latchValue);
+        clonePhi->addIncoming(phi.getIncomingValueForBlock(preheader), guard);
+    }
+
+    // 出口块的LCSSA phi改为从复制的latch取值
+    for (PHINode &phi: exit->phis()) {
+        int index = phi.getBasicBlockIndex(latch);
+        Value *value = phi.getIncomingValue(index);
+        phi.setIncomingBlock(index, cloneLatch);
+        Value *mapped = VMap.lookup(value);
+        phi.setIncomingValue(index, mapped ? mapped : value);
+    }
+
+    // 原循环中的比较恒为不相等，循环在归纳变量的下一个值等于last时退出
+    LC.cmp->replaceAllUsesWith(ConstantInt::getBool(LC.cmp->getType(), !isEq));
+    LC.cmp->eraseFromParent();
+    auto *latchBr = cast<BranchInst>(latch->getTerminator());
+    builder.SetInsertPoint(latchBr);
+    auto *step = cast<SCEVConstant>(LC.AR->getStepRecurrence(SE))->getValue();
+    Value *next = builder.CreateAdd(LC.iv, step, LC.iv->getName() + ".peel.next");
+    Value *cont = builder.CreateICmpNE(next, LC.last, "peel.cont");
+    Value *oldCond = latchBr->getCondition();
+    // 循环的元数据（如-sysy-unroll-function指定的展开次数）保存在latch的跳转指令上
+    BranchInst *newBr = builder.CreateCondBr(cont, header, lastPreheader);
+    newBr->setMetadata(LLVMContext::MD_loop, latchBr->getMetadata(LLVMContext::MD_loop));
+    latchBr->eraseFromParent();
+    RecursivelyDeleteTriviallyDeadInstructions(oldCond);
+
+    // 新的块都不构成循环，属于外层循环
+    if (parent) {
+        parent->addBasicBlockToLoop(lastPreheader, LI);
+        for (BasicBlock *BB: clones) {
+            parent->addBasicBlockToLoop(BB, LI);
+        }
+    }
+    DT.recalculate(*F);
+}
+
+PreservedAnalyses LoopPeelPass::run(Function &F, FunctionAnalysisManager &FAM) {
+    auto &LI = FAM.getResult<LoopAnalysis>(F);
+    auto &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+    auto &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+    auto &AC = FAM.getResult<AssumptionAnalysis>(F);
+    auto &TTI = FAM.getResult<TargetIRAnalysis>(F);
+
+    SmallVector<Loop *, 8> candidates;
+    for (Loop *L: LI.getLoopsInPreorder()) {
+        if (L->isInnermost()) {
+            candidates.push_back(L);
+        }
+    }
+
+    bool changed = false;
+    for (Loop *L: candidates) {
+        // 之前的SimplifyCFG可能删除了preheader等结构
+        if (!L->isLoopSimplifyForm()) {
+            changed |= simplifyLoop(L, &DT, &LI, &SE, &AC, nullptr, false);
+        }
+        if (!canPeel(L) || !L->isSafeToClone()) {
+            continue;
+        }
+        unsigned numCalls;
+        bool notDuplicatable, convergent;
+        SmallPtrSet<const Value *, 32> ephValues;
+        CodeMetrics::collectEphemeralValues(L, &AC, ephValues);
+        unsigned size = ApproximateLoopSize(L, numCalls, notDuplicatable, convergent, TTI, ephValues, 2);
+        if (notDuplicatable || convergent) {
+            continue;
+        }
+        if (mergeIdenticalIncomingOps(L, DT)) {
+            SE.forgetLoop(L);
+            changed = true;
+        }
+        changed |= formLCSSARecursively(*L, DT, &LI, &SE);
+        std::string header = L->getHeader()->getName().str();
+
+        // 第一次迭代
+        TargetTransformInfo::PeelingPreferences PP = gatherPeelingPreferences(L, SE, TTI, None, false);
+        // computePeelCount最多剥离threshold / size - 1次迭代
+        unsigned threshold = std::min<unsigned>(PeelThreshold, (MaxPeelCount + 1) * size);
+        computePeelCount(L, size, PP, SE.getSmallConstantTripCount(L), DT, SE, threshold);
+        if (PP.PeelCount && peelLoop(L, PP.PeelCount, &LI, &SE, DT, &AC, true)) {
+            log("peel") << F.getName().str() << ": " << header << " first " << PP.PeelCount << std::endl;
+            NumPeeledFirst++;
+            foldKnownCompares(L, SE);
+            changed = true;
+        }
+
+        // 最后一次迭代
+        if (2 * size <= PeelThreshold) {
+            if (auto LC = findLastIterationCompare(L, SE, DT)) {
+                peelLastIteration(L, *LC, LI, DT, SE);
+                log("peel") << F.getName().str() << ": " << header << " last" << std::endl;
+                NumPeeledLast++;
+                changed = true;
+            }
+        }
+    }
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
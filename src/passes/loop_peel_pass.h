@@ -0,0 +1,18 @@
+#ifndef SYSY_COMPILER_PASSES_LOOP_PEEL_PASS_H
+#define SYSY_COMPILER_PASSES_LOOP_PEEL_PASS_H
+
+#include <llvm/IR/PassManager.h>
+
+// 最内层循环的剥离：把只在第一次或最后一次迭代中结果不同的条件移出循环
+// 第一次迭代：条件只与归纳变量是否等于初值有关（如动态规划中的if (i == 0)），
+// 或某个phi在若干次迭代后变为不变量时，由LLVM的peelLoop剥离前几次迭代，
+// 剩余循环中结果已知的比较用SCEV折叠为常量
+// 最后一次迭代：条件是归纳变量与它在最后一次迭代的值比较是否相等（如if (i == n - 1)），
+// 循环少执行一次，条件在其中恒不成立，之后复制一份循环体执行最后一次迭代，条件恒成立
+// 剥离的迭代和循环本身的规模受阈值限制
+class LoopPeelPass : public llvm::PassInfoMixin<LoopPeelPass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+};
+
+#endif //SYSY_COMPILER_PASSES_LOOP_PEEL_PASS_H
@@ -0,0 +1,419 @@
+#include <optional>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include <llvm/Transforms/Utils/LoopSimplify.h>
+#include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
+#include "log.h"
+#include "matmul_pass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "matmul"
+
+STATISTIC(NumMatmuls, "Number of loop nests replaced by matrix multiply kernels");
+
+static cl::opt<bool> EnableMatmulKernel(
+        "matmul-kernel", cl::init(false),
+        cl::desc("Replace matrix multiply loop nests with runtime library kernels"));
+
+// 一次调用和分块的开销约相当于数千次乘加，更小的矩阵（如3x3）保留原循环
+static cl::opt<unsigned> MinMatmulWork(
+        "matmul-min-work", cl::init(8192), cl::Hidden,
+        cl::desc("Min number of multiply-adds to call the matrix multiply kernel"));
+
+namespace {
+
+    // 访存地址分解为 base + Σ coeffs[d] * (第d层循环的迭代序号)，系数以字节为单位
+    struct Access {
+        Value *ptr;
+        const SCEV *base;
+        int64_t coeffs[3];
+    };
+
+    // C[i][j] = init + Σ A[i][k] * B[k][j]，i、j、k为三种角色所在的层（由外向内为0、1、2）
+    struct Matmul {
+        Loop *loops[3];
+        // 各层循环体的执行次数
+        const SCEV *trips[3];
+        unsigned i, j, k;
+        Access a, b, c;
+        Type *elemType;
+        // init为原来的C[i][j]时为true，为0时为false
+        bool accumulate;
+    };
+
+} // namespace
+
+static std::optional<Access> analyzeAccess(Value *ptr, ArrayRef<Loop *> loops, ScalarEvolution &SE) {
+    Access access{ptr, nullptr, {0, 0, 0}};
+    const SCEV *S = SE.getSCEV(ptr);
+    while (auto *AR = dyn_cast<SCEVAddRecExpr>(S)) {
+        auto *it = llvm::find(loops, AR->getLoop());
+        auto *step = dyn_cast<SCEVConstant>(AR->getStepRecurrence(SE));
+        if (it == loops.end() || !AR->isAffine() || !step) {
+            return std::nullopt;
+        }
+        access.coeffs[it - loops.begin()] = step->getAPInt().getSExtValue();
+        S = AR->getStart();
+    }
+    if (!SE.isLoopInvariant(S, loops.front())) {
+        return std::nullopt;
+    }
+    access.base = S;
+    return access;
+}
+
+// 循环体的执行次数：未旋转的循环只在循环头退出，回边的执行次数就是循环体的执行次数
+// 迭代次数在整个嵌套中不变（矩形的迭代空间）
+static const SCEV *getTripCount(Loop *L, Loop *outermost, ScalarEvolution &SE) {
+    BasicBlock *header = L->getHeader();
+    if (L->getExitingBlock() != header || L->getLoopLatch() == header || !L->getExitBlock()) {
+        return nullptr;
+    }
+    const SCEV *BTC = SE.getBackedgeTakenCount(L);
+    if (isa<SCEVCouldNotCompute>(BTC) || !BTC->getType()->isIntegerTy(32) ||
+        !SE.isLoopInvariant(BTC, outermost)) {
+        return nullptr;
+    }
+    return BTC;
+}
+
+// 在循环L中、每次迭代都执行的指令
+static bool isExecutedEachIteration(Instruction *I, Loop *L, LoopInfo &LI, DominatorTree &DT) {
+    return LI.getLoopFor(I->getParent()) == L && DT.dominates(I->getParent(), L->getLoopLatch());
+}
+
+// 匹配两个load的乘积
+static bool matchProduct(Value *V, unsigned opcode, LoadInst *&x, LoadInst *&y) {
+    auto *mul = dyn_cast<BinaryOperator>(V);
+    if (!mul || mul->getOpcode() != opcode) {
+        return false;
+    }
+    x = dyn_cast<LoadInst>(mul->getOperand(0));
+    y = dyn_cast<LoadInst>(mul->getOperand(1));
+    return x && y && x != y;
+}
+
+// 按地址步长确定A、B、C和三层循环的角色：C在k上、A在j上、B在i上步长为0，
+// A沿k、B和C沿j连续，另一维的步长（行长度）为元素大小的正整数倍
+static bool assignRoles(Matmul &MM, const Access &x, const Access &y, int64_t size) {
+    auto findZero = [](const Access &access) -> std::optional<unsigned> {
+        std::optional<unsigned> level;
+        for (unsigned d = 0; d < 3; d++) {
+            if (access.coeffs[d] == 0) {
+                if (level) {
+                    return std::nullopt;
+                }
+                level = d;
+            }
+        }
+        return level;
+    };
+    auto isRow = [&](int64_t coeff) { return coeff > 0 && coeff % size == 0; };
+
+    auto k = findZero(MM.c);
+    if (!k) {
+        return false;
+    }
+    for (auto [a, b]: {std::pair(&x, &y), std::pair(&y, &x)}) {
+        auto j = findZero(*a);
+        auto i = findZero(*b);
+        if (!i || !j || *i == *j || *i == *k || *j == *k) {
+            continue;
+        }
+        if (a->coeffs[*k] != size || b->coeffs[*j] != size || MM.c.coeffs[*j] != size ||
+            !isRow(a->coeffs[*i]) || !isRow(b->coeffs[*k]) || !isRow(MM.c.coeffs[*i])) {
+            continue;
+        }
+        MM.i = *i;
+        MM.j = *j;
+        MM.k = *k;
+        MM.a = *a;
+        MM.b = *b;
+        return true;
+    }
+    return false;
+}
+
+static std::optional<Matmul> analyzeNest(Loop *L0, LoopInfo &LI, ScalarEvolution &SE,
+                                         DominatorTree &DT, AAResults &AA) {
+    if (L0->getSubLoops().size() != 1 || L0->getSubLoops().front()->getSubLoops().size() != 1) {
+        return std::nullopt;
+    }
+    Loop *L1 = L0->getSubLoops().front();
+    Loop *L2 = L1->getSubLoops().front();
+    if (!L2->isInnermost() || !L0->getLoopPreheader() || !L0->getExitBlock()) {
+        return std::nullopt;
+    }
+
+    Matmul MM{{L0, L1, L2}};
+    for (unsigned d = 0; d < 3; d++) {
+        MM.trips[d] = getTripCount(MM.loops[d], L0, SE);
+        if (!MM.trips[d]) {
+            return std::nullopt;
+        }
+    }
+    // 内层循环在外层的每次迭代中都会执行
+    if (!DT.dominates(L2->getHeader(), L1->getLoopLatch()) ||
+        !DT.dominates(L1->getHeader(), L0->getLoopLatch())) {
+        return std::nullopt;
+    }
+
+    // 嵌套中只有一个store和参与乘加的load，没有其他副作用，定义的值不在嵌套外使用
+    StoreInst *store = nullptr;
+    SmallPtrSet<LoadInst *, 4> loads;
+    for (BasicBlock *BB: L0->blocks()) {
+        for (Instruction &I: *BB) {
+            if (auto *SI = dyn_cast<StoreInst>(&I)) {
+                if (store || !SI->isSimple()) {
+                    return std::nullopt;
+                }
+                store = SI;
+            } else if (auto *load = dyn_cast<LoadInst>(&I)) {
+                if (!load->isSimple()) {
+                    return std::nullopt;
+                }
+                loads.insert(load);
+            } else if (I.mayReadOrWriteMemory() || I.mayHaveSideEffects()) {
+                return std::nullopt;
+            }
+            for (User *user: I.users()) {
+                if (!L0->contains(cast<Instruction>(user))) {
+                    return std::nullopt;
+                }
+            }
+        }
+    }
+    if (!store) {
+        return std::nullopt;
+    }
+    MM.elemType = store->getValueOperand()->getType();
+    if (!MM.elemType->isIntegerTy(32) && !MM.elemType->isFloatTy()) {
+        return std::nullopt;
+    }
+    unsigned addOpcode = MM.elemType->isFloatTy() ? Instruction::FAdd : Instruction::Add;
+    unsigned mulOpcode = MM.elemType->isFloatTy() ? Instruction::FMul : Instruction::Mul;
+    const SCEV *storePtr = SE.getSCEV(store->getPointerOperand());
+    auto isLoadOfC = [&](Value *V) {
+        auto *load = dyn_cast<LoadInst>(V);
+        return load && SE.getSCEV(load->getPointerOperand()) == storePtr;
+    };
+
+    LoadInst *x, *y;
+    Value *init;
+    if (isExecutedEachIteration(store, L2, LI, DT)) {
+        // C[i][j] = C[i][j] + A * B
+        auto *sum = dyn_cast<BinaryOperator>(store->getValueOperand());
+        if (!sum || sum->getOpcode() != addOpcode) {
+            return std::nullopt;
+        }
+        unsigned op = isLoadOfC(sum->getOperand(0)) ? 0 : 1;
+        init = sum->getOperand(op);
+        if (!isLoadOfC(init) || !matchProduct(sum->getOperand(1 - op), mulOpcode, x, y)) {
+            return std::nullopt;
+        }
+        MM.accumulate = true;
+    } else if (isExecutedEachIteration(store, L1, LI, DT)) {
+        // s = init; s = s + A * B; ... C[i][j] = s，循环出口处的s经过LCSSA的phi
+        Value *V = store->getValueOperand();
+        while (auto *phi = dyn_cast<PHINode>(V)) {
+            if (phi->getNumIncomingValues() != 1) {
+                break;
+            }
+            V = phi->getIncomingValue(0);
+        }
+        auto *acc = dyn_cast<PHINode>(V);
+        if (!acc || acc->getParent() != L2->getHeader() || acc->getNumIncomingValues() != 2) {
+            return std::nullopt;
+        }
+        unsigned latchIndex = L2->contains(acc->getIncomingBlock(0)) ? 0 : 1;
+        init = acc->getIncomingValue(1 - latchIndex);
+        auto *update = dyn_cast<BinaryOperator>(acc->getIncomingValue(latchIndex));
+        if (!update || update->getOpcode() != addOpcode || L2->contains(acc->getIncomingBlock(1 - latchIndex)) ||
+            !isExecutedEachIteration(update, L2, LI, DT)) {
+            return std::nullopt;
+        }
+        unsigned op = update->getOperand(0) == acc ? 0 : 1;
+        if (update->getOperand(op) != acc || !matchProduct(update->getOperand(1 - op), mulOpcode, x, y)) {
+            return std::nullopt;
+        }
+        if (auto *initLoad = dyn_cast<LoadInst>(init);
+                initLoad && isLoadOfC(initLoad) && isExecutedEachIteration(initLoad, L1, LI, DT)) {
+            MM.accumulate = true;
+        } else if (auto *C = dyn_cast<Constant>(init); C && C->isNullValue()) {
+            MM.accumulate = false;
+        } else {
+            return std::nullopt;
+        }
+    } else {
+        return std::nullopt;
+    }
+    if (!isExecutedEachIteration(x, L2, LI, DT) || !isExecutedEachIteration(y, L2, LI, DT) ||
+        loads.size() != (isa<LoadInst>(init) ? 3 : 2) || !loads.count(x) || !loads.count(y) ||
+        x->getType() != MM.elemType || y->getType() != MM.elemType) {
+        return std::nullopt;
+    }
+
+    auto accessX = analyzeAccess(x->getPointerOperand(), MM.loops, SE);
+    auto accessY = analyzeAccess(y->getPointerOperand(), MM.loops, SE);
+    auto accessC = analyzeAccess(store->getPointerOperand(), MM.loops, SE);
+    if (!accessX || !accessY || !accessC) {
+        return std::nullopt;
+    }
+    MM.c = *accessC;
+    const DataLayout &DL = L0->getHeader()->getModule()->getDataLayout();
+    if (!assignRoles(MM, *accessX, *accessY, DL.getTypeAllocSize(MM.elemType))) {
+        return std::nullopt;
+    }
+
+    // C与A、B不能重叠，kernel中C的写入不会影响之后读到的A和B
+    auto location = [](const Access &access) { return MemoryLocation::getBeforeOrAfter(access.ptr); };
+    if (!AA.isNoAlias(location(MM.c), location(MM.a)) || !AA.isNoAlias(location(MM.c), location(MM.b))) {
+        return std::nullopt;
+    }
+
+    // 迭代次数都是常量时在编译期判断规模
+    uint64_t work = 1;
+    for (const SCEV *trip: MM.trips) {
+        auto *tripConst = dyn_cast<SCEVConstant>(trip);
+        work = tripConst && work ? work * tripConst->getAPInt().getZExtValue() : 0;
+    }
+    if (work && work < MinMatmulWork) {
+        return std::nullopt;
+    }
+    return MM;
+}
+
+// void _sysy_matmul_*(m, n, k, a, lda, b, ldb, c, ldc, accumulate)
+static FunctionCallee getKernel(Module &M, Type *elemType) {
+    LLVMContext &C = M.getContext();
+    Type *i32 = Type::getInt32Ty(C);
+    Type *ptr = elemType->getPointerTo();
+    auto *type = FunctionType::get(Type::getVoidTy(C), {i32, i32, i32, ptr, i32, ptr, i32, ptr, i32, i32}, false);
+    FunctionCallee kernel = M.getOrInsertFunction(
+            elemType->isFloatTy() ? "_sysy_matmul_f32" : "_sysy_matmul_i32", type);
+
+    // 只访问参数指向的内存且A、B只读，别名分析可以据此区分调用前后的其他数组
+    auto *F = cast<Function>(kernel.getCallee());
+    F->addFnAttr(Attribute::ArgMemOnly);
+    F->addFnAttr(Attribute::NoUnwind);
+    F->addFnAttr(Attribute::WillReturn);
+    F->addFnAttr(Attribute::NoFree);
+    F->addFnAttr(Attribute::NoSync);
+    for (unsigned arg: {3, 5, 7}) {
+        F->addParamAttr(arg, Attribute::NoCapture);
+    }
+    F->addParamAttr(3, Attribute::ReadOnly);
+    F->addParamAttr(5, Attribute::ReadOnly);
+    return kernel;
+}
+
+// 在嵌套前调用kernel并跳到嵌套的出口；规模不是常量时保留原循环，运行时按乘加次数选择
+static void replaceNest(Matmul &MM, ScalarEvolution &SE) {
+    Loop *L0 = MM.loops[0];
+    BasicBlock *preheader = L0->getLoopPreheader();
+    BasicBlock *header = L0->getHeader();
+    BasicBlock *exit = L0->getExitBlock();
+    Function *F = header->getParent();
+    Module *M = F->getParent();
+    LLVMContext &C = F->getContext();
+    const DataLayout &DL = M->getDataLayout();
+
+    Instruction *term = preheader->getTerminator();
+    SCEVExpander expander(SE, DL, "matmul");
+    IRBuilder<> builder(term);
+    Type *ptr = MM.elemType->getPointerTo();
+    auto trip = [&](unsigned level) {
+        return expander.expandCodeFor(MM.trips[level], builder.getInt32Ty(), term);
+    };
+    auto base = [&](const Access &access) {
+        return builder.CreateBitCast(expander.expandCodeFor(access.base, access.base->getType(), term), ptr);
+    };
+    auto rowLength = [&](const Access &access, unsigned level) {
+        return builder.getInt32(access.coeffs[level] / (int64_t) DL.getTypeAllocSize(MM.elemType));
+    };
+    Value *m = trip(MM.i);
+    Value *n = trip(MM.j);
+    Value *k = trip(MM.k);
+    Value *args[] = {
+            m, n, k,
+            base(MM.a), rowLength(MM.a, MM.i),
+            base(MM.b), rowLength(MM.b, MM.k),
+            base(MM.c), rowLength(MM.c, MM.i),
+            builder.getInt32(MM.accumulate)
+    };
+    Value *work = builder.CreateMul(builder.CreateMul(builder.CreateZExt(m, builder.getInt64Ty()),
+                                                      builder.CreateZExt(n, builder.getInt64Ty())),
+                                    builder.CreateZExt(k, builder.getInt64Ty()), "matmul.work");
+    Value *large = builder.CreateICmpUGE(work, builder.getInt64(MinMatmulWork), "matmul.large");
+
+    auto *callBB = BasicBlock::Create(C, "matmul", F, header);
+    builder.SetInsertPoint(callBB);
+    builder.CreateCall(getKernel(*M, MM.elemType), args);
+    builder.CreateBr(exit);
+    for (PHINode &phi: exit->phis()) {
+        phi.addIncoming(phi.getIncomingValueForBlock(header), callBB);
+    }
+
+    term->eraseFromParent();
+    builder.SetInsertPoint(preheader);
+    if (isa<Constant>(large)) {
+        builder.CreateBr(callBB);
+        EliminateUnreachableBlocks(*F);
+    } else {
+        builder.CreateCondBr(large, callBB, header);
+    }
+}
+
+PreservedAnalyses MatmulPass::run(Function &F, FunctionAnalysisManager &FAM) {
+    if (!EnableMatmulKernel) {
+        return PreservedAnalyses::all();
+    }
+
+    // 每次替换后重新计算分析结果，保留了原循环的嵌套不再分析
+    SmallPtrSet<BasicBlock *, 8> visited;
+    bool changed = false;
+    while (true) {
+        auto &LI = FAM.getResult<LoopAnalysis>(F);
+        auto &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+        auto &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+        auto &AA = FAM.getResult<AAManager>(F);
+        auto &AC = FAM.getResult<AssumptionAnalysis>(F);
+
+        std::optional<Matmul> MM;
+        for (Loop *L: LI.getLoopsInPreorder()) {
+            if (visited.insert(L->getHeader()).second) {
+                // 外层有循环时，嵌套前可能没有单独的preheader
+                changed |= simplifyLoop(L, &DT, &LI, &SE, &AC, nullptr, false);
+                MM = analyzeNest(L, LI, SE, DT, AA);
+            }
+            if (MM) {
+                break;
+            }
+        }
+        if (!MM) {
+            break;
+        }
+
+        log("matmul") << F.getName().str() << ": " << MM->loops[0]->getHeader()->getName().str()
+                      << (MM->elemType->isFloatTy() ? " float" : " int") << ", loops (i, j, k) at levels ("
+                      << MM->i << ", " << MM->j << ", " << MM->k << ")"
+                      << (MM->accumulate ? ", accumulate" : "") << std::endl;
+        replaceNest(*MM, SE);
+        FAM.invalidate(F, PreservedAnalyses::none());
+        NumMatmuls++;
+        changed = true;
+    }
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
@@ -0,0 +1,19 @@
+#ifndef SYSY_COMPILER_PASSES_MATMUL_PASS_H
+#define SYSY_COMPILER_PASSES_MATMUL_PASS_H
+
+#include <llvm/IR/PassManager.h>
+
+// 矩阵乘法的识别：三层循环嵌套 C[i][j] = C[i][j] + A[i][k] * B[k][j]（三层循环的顺序任意），
+// 或最内层在局部变量中累加、循环后写入C[i][j]的形式，替换为运行时库中分块并向量化的_sysy_matmul_*，
+// 元素为int或float，数组可以是全局数组或数组参数
+// 各层循环的角色由访存地址在各层上的步长确定，C与A、B不能有别名，嵌套中不能有其他访存和副作用
+// 每个C元素仍按k从小到大累加，浮点结果与原循环相同
+// 乘加次数小于阈值时保留原循环，迭代次数不是常量时在运行时判断
+// 需要在循环旋转之前进行，此时各层循环的迭代次数就是循环体的执行次数
+// 运行时库需要包含矩阵乘法的实现，因此默认关闭，使用 -mllvm -matmul-kernel 开启
+class MatmulPass : public llvm::PassInfoMixin<MatmulPass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+};
+
+#endif //SYSY_COMPILER_PASSES_MATMUL_PASS_H
@@ -26,6 +26,15 @@ static bool promoteMemoryToRegister(Function &F, DominatorTree &DT, AssumptionCa
     BasicBlock &entryBB = F.getEntryBlock();
     bool isChange = false;
 
+    // 先将只用常量下标访问的局部数组拆分为标量，使其能够参与提升
+    std::vector<AllocaInst *> arrays;
+    for (Instruction &inst : entryBB)
+        if (AllocaInst *AI = dyn_cast<AllocaInst>(&inst))
+            if (AI->getAllocatedType()->isArrayTy())
+                arrays.push_back(AI);
+    for (AllocaInst *AI : arrays)
+        isChange |= splitArrayAlloca(AI);
+
     while (true) {
         allocas.clear();
 
@@ -29,8 +29,9 @@
 #include "llvm/IR/Type.h"
 #include "llvm/IR/User.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Transforms/Utils/Local.h"
-#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+#include "mem2reg_pass_helper.h"
 #include <algorithm>
 #include <cassert>
 #include <iterator>
@@ -45,6 +46,12 @@ STATISTIC(NumLocalPromoted, "Number of alloca's promoted within one block");
 STATISTIC(NumSingleStore,   "Number of alloca's promoted with a single store");
 STATISTIC(NumDeadAlloca,    "Number of dead alloca's removed");
 STATISTIC(NumPHIInsert,     "Number of PHI nodes inserted");
+STATISTIC(NumArraySplit,    "Number of local arrays split into scalars");
+
+// 数组拆分的元素个数上限，过大的数组拆分后会产生大量的PHI节点，得不偿失
+static cl::opt<unsigned> ArraySplitThreshold(
+        "mem2reg-array-split-threshold", cl::Hidden, cl::init(64),
+        cl::desc("Max number of elements of a local array to be split into scalars"));
 
 // 判断是否能从内存提升到寄存器
 // 不可提升的情况：volatile属性的变量、有被取址操作的局部变量
@@ -70,6 +77,92 @@ bool llvm::isAllocaPromotable(const AllocaInst *AI) {
     return true;
 }
 
+// 收集从Ptr出发，经由常量下标GEP链到达的所有load/store指令，以及它们访问的元素下标
+// Offset为Ptr相对数组首地址的字节偏移，GEPs按照先序记录途经的GEP指令
+// 出现变量下标、越界访问、非对齐访问或指针逃逸（如作为函数参数）时返回false
+static bool collectArrayAccesses(Value *Ptr, int64_t Offset, Type *ElemTy,
+                                 uint64_t ElemSize, uint64_t NumElems,
+                                 const DataLayout &DL,
+                                 SmallVectorImpl<std::pair<Instruction *, unsigned>> &Accesses,
+                                 SmallVectorImpl<GetElementPtrInst *> &GEPs) {
+    for (User *U : Ptr->users()) {
+        if (auto *GEPI = dyn_cast<GetElementPtrInst>(U)) {
+            if (GEPI->getPointerOperand() != Ptr)
+                return false;
+            APInt GEPOffset(DL.getIndexTypeSizeInBits(GEPI->getType()), 0);
+            if (!GEPI->accumulateConstantOffset(DL, GEPOffset))
+                return false;
+            GEPs.push_back(GEPI);
+            if (!collectArrayAccesses(GEPI, Offset + GEPOffset.getSExtValue(), ElemTy,
+                                      ElemSize, NumElems, DL, Accesses, GEPs))
+                return false;
+            continue;
+        }
+
+        // 只允许以元素类型访问数组中的某个完整元素
+        Type *AccessTy;
+        if (auto *LI = dyn_cast<LoadInst>(U)) {
+            AccessTy = LI->getType();
+        } else if (auto *SI = dyn_cast<StoreInst>(U)) {
+            if (SI->getValueOperand() == Ptr)
+                return false;
+            AccessTy = SI->getValueOperand()->getType();
+        } else {
+            return false;
+        }
+        if (AccessTy != ElemTy || Offset < 0 || Offset % ElemSize != 0 ||
+            uint64_t(Offset) / ElemSize >= NumElems)
+            return false;
+        Accesses.emplace_back(cast<Instruction>(U), unsigned(uint64_t(Offset) / ElemSize));
+    }
+    return true;
+}
+
+// 标量替换：将只用常量下标访问的局部数组拆分为每个元素一个alloca，之后即可由mem2reg提升
+// 例如 int d[4]; d[1] = 2; 拆分后 d[1] 变为独立的 d.1，数组不再占用栈空间
+bool llvm::splitArrayAlloca(AllocaInst *AI) {
+    if (!AI->isStaticAlloca() || !AI->getAllocatedType()->isArrayTy())
+        return false;
+
+    // 多维数组按行优先展开为一维，求出元素类型和元素个数
+    Type *ElemTy = AI->getAllocatedType();
+    uint64_t NumElems = 1;
+    while (auto *ArrTy = dyn_cast<ArrayType>(ElemTy)) {
+        NumElems *= ArrTy->getNumElements();
+        ElemTy = ArrTy->getElementType();
+    }
+    if (NumElems == 0 || NumElems > ArraySplitThreshold || !ElemTy->isSingleValueType())
+        return false;
+
+    const DataLayout &DL = AI->getModule()->getDataLayout();
+    uint64_t ElemSize = DL.getTypeAllocSize(ElemTy);
+    SmallVector<std::pair<Instruction *, unsigned>, 16> Accesses;
+    SmallVector<GetElementPtrInst *, 16> GEPs;
+    if (!collectArrayAccesses(AI, 0, ElemTy, ElemSize, NumElems, DL, Accesses, GEPs))
+        return false;
+
+    // 仅为被访问到的元素创建alloca，放在原数组的位置（入口块）
+    SmallVector<AllocaInst *, 16> Elems(NumElems, nullptr);
+    for (auto &[Access, Index] : Accesses) {
+        AllocaInst *&Elem = Elems[Index];
+        if (!Elem)
+            Elem = new AllocaInst(ElemTy, AI->getType()->getAddressSpace(), nullptr,
+                                  DL.getABITypeAlign(ElemTy),
+                                  AI->getName() + "." + Twine(Index), AI);
+        if (auto *LI = dyn_cast<LoadInst>(Access))
+            LI->setOperand(LoadInst::getPointerOperandIndex(), Elem);
+        else
+            cast<StoreInst>(Access)->setOperand(StoreInst::getPointerOperandIndex(), Elem);
+    }
+
+    // GEP按先序记录，逆序删除即可保证删除时没有user
+    for (GetElementPtrInst *GEPI : llvm::reverse(GEPs))
+        GEPI->eraseFromParent();
+    AI->eraseFromParent();
+    ++NumArraySplit;
+    return true;
+}
+
 namespace {
 
     struct AllocaInfo {
@@ -387,6 +480,14 @@ static bool promoteSingleBlockAlloca(AllocaInst *AI, const AllocaInfo &Info,
         LBI.deleteValue(LI);
     }
 
+    // 此时只剩下store指令，全部删除后再删除alloca
+    while (!AI->use_empty()) {
+        StoreInst *SI = cast<StoreInst>(AI->user_back());
+        SI->eraseFromParent();
+        LBI.deleteValue(SI);
+    }
+
+    AI->eraseFromParent();
     ++NumLocalPromoted;
     return true;
 }
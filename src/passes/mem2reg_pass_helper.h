@@ -8,6 +8,7 @@ namespace llvm {
     class DominatorTree;
     class AssumptionCache;
     bool isAllocaPromotable(const AllocaInst *AI);
+    bool splitArrayAlloca(AllocaInst *AI);
     void PromoteMemToReg(ArrayRef<AllocaInst *> Allocas, DominatorTree &DT,
                          AssumptionCache *AC = nullptr);
 
@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <optional>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PatternMatch.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/MathExtras.h>
+#include "log.h"
+#include "memoize_pass.h"
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+
+#define DEBUG_TYPE "memoize"
+
+STATISTIC(NumMemoized, "Number of functions memoized");
+
+// 每个函数的记忆化表最多有2^bits项，每项保存有效标记、参数和返回值
+// 参数的范围未知时使用最大的表，范围已知时按参数组合的个数缩小
+static cl::opt<unsigned> TableBits(
+        "memoize-table-bits", cl::init(16), cl::Hidden,
+        cl::desc("Log2 of the max number of entries in a memoization table"));
+
+// 参数越多，参数组合的重复越少，哈希表的命中率越低
+static const unsigned MaxArgs = 3;
+// 判断被调函数是否为纯函数时最多向下查看的层数
+static const unsigned MaxCalleeDepth = 4;
+// 多个参数时哈希值的乘数（2^32除以黄金分割比）
+static const uint32_t HashMultiplier = 0x9E3779B1;
+// 表的最小项数（2的幂次）
+static const unsigned MinTableBits = 4;
+
+namespace {
+
+    bool isScalar(const Type *type) {
+        return type->isIntegerTy(32) || type->isFloatTy();
+    }
+
+    // 纯函数：只读写自己的局部变量，调用的函数也都是纯函数，结果只由参数决定
+    // self是正在检查的函数本身，对它的递归调用不影响结论
+    bool isPure(const Function &F, const Function *self, unsigned depth) {
+        for (const Instruction &I: instructions(F)) {
+            if (auto *CB = dyn_cast<CallBase>(&I)) {
+                const Function *callee = CB->getCalledFunction();
+                if (!callee) {
+                    return false;
+                }
+                if (callee == self || CB->doesNotAccessMemory()) {
+                    continue;
+                }
+                if (callee->isDeclaration() || depth >= MaxCalleeDepth || !isPure(*callee, callee, depth + 1)) {
+                    return false;
+                }
+                continue;
+            }
+
+            const Value *ptr = getLoadStorePointerOperand(&I);
+            if (!ptr) {
+                if (I.mayReadOrWriteMemory()) {
+                    return false;
+                }
+                continue;
+            }
+            if (isa<LoadInst>(I) ? !cast<LoadInst>(I).isSimple() : !cast<StoreInst>(I).isSimple()) {
+                return false;
+            }
+            SmallVector<const Value *, 4> objects;
+            getUnderlyingObjects(ptr, objects, nullptr, 0);
+            for (const Value *obj: objects) {
+                if (!isa<AllocaInst>(obj)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // 一个参数在所有递归调用中的变化
+    struct ArgDomain {
+        // 递归调用的实参都不大于（不小于）形参，或是常量
+        bool decreasing = true;
+        bool increasing = true;
+        // 实参与形参之差的最大绝对值，只在差都是常量时（stepKnown）有意义
+        uint64_t maxStep = 0;
+        bool stepKnown = true;
+        // 以常量为实参的递归调用个数
+        unsigned constants = 0;
+    };
+
+    // 记录一次递归调用中实参相对形参的变化，无法判断方向时返回false
+    bool addIntStep(ArgDomain &domain, Value *actual, Argument *formal, CallBase *CB, ScalarEvolution &SE) {
+        if (isa<Constant>(actual)) {
+            domain.constants++;
+            return true;
+        }
+        const SCEV *actualSCEV = SE.getSCEV(actual);
+        const SCEV *formalSCEV = SE.getSCEV(formal);
+        const SCEV *diff = SE.getMinusSCEV(actualSCEV, formalSCEV);
+        if (auto *constant = dyn_cast<SCEVConstant>(diff)) {
+            int64_t step = constant->getAPInt().getSExtValue();
+            domain.decreasing = domain.decreasing && step <= 0;
+            domain.increasing = domain.increasing && step >= 0;
+            domain.maxStep = std::max<uint64_t>(domain.maxStep, step < 0 ? -step : step);
+            return domain.decreasing || domain.increasing;
+        }
+
+        // 差不是常量时（如循环中的f(n - i)）借助调用点处成立的条件判断方向
+        // 差是循环中的仿射量时，起点和步长同号则整个循环中都是该符号（SysY中有符号溢出是未定义行为）
+        domain.stepKnown = false;
+        bool nonPositive = SE.isKnownPredicateAt(ICmpInst::ICMP_SLE, actualSCEV, formalSCEV, CB);
+        bool nonNegative = SE.isKnownPredicateAt(ICmpInst::ICMP_SGE, actualSCEV, formalSCEV, CB);
+        if (auto *AR = dyn_cast<SCEVAddRecExpr>(diff); AR && AR->isAffine()) {
+            const SCEV *start = AR->getStart();
+            const SCEV *step = AR->getStepRecurrence(SE);
+            nonPositive = nonPositive || (SE.isKnownNonPositive(start) && SE.isKnownNonPositive(step));
+            nonNegative = nonNegative || (SE.isKnownNonNegative(start) && SE.isKnownNonNegative(step));
+        }
+        domain.decreasing = domain.decreasing && nonPositive;
+        domain.increasing = domain.increasing && nonNegative;
+        return domain.decreasing || domain.increasing;
+    }
+
+    bool addFloatStep(ArgDomain &domain, Value *actual, Argument *formal) {
+        domain.stepKnown = false;
+        const APFloat *step;
+        if (isa<Constant>(actual)) {
+            domain.constants++;
+            return true;
+        } else if (actual == formal) {
+            return true;
+        } else if (match(actual, m_FSub(m_Specific(formal), m_APFloat(step)))) {
+            domain.decreasing = domain.decreasing && !step->isNegative();
+            domain.increasing = domain.increasing && step->isNegative();
+        } else if (match(actual, m_c_FAdd(m_Specific(formal), m_APFloat(step)))) {
+            domain.decreasing = domain.decreasing && step->isNegative();
+            domain.increasing = domain.increasing && !step->isNegative();
+        } else {
+            return false;
+        }
+        return domain.decreasing || domain.increasing;
+    }
+
+    // 命中率的判断：每个参数在所有递归调用中都朝同一方向变化（或是常量）时，
+    // 递归调用树中的参数组合局限在入口的参数与递归终点之间，多个递归调用点（或循环中的调用点）
+    // 必然反复访问相同的参数组合；参数按其他方式变化（如n / 2、x * y）时不记忆化
+    std::optional<SmallVector<ArgDomain, MaxArgs>> analyzeRecursion(Function &F, ScalarEvolution &SE) {
+        SmallVector<ArgDomain, MaxArgs> domains(F.arg_size());
+        for (Instruction &I: instructions(F)) {
+            auto *CB = dyn_cast<CallBase>(&I);
+            if (!CB || CB->getCalledFunction() != &F) {
+                continue;
+            }
+            for (unsigned i = 0; i < F.arg_size(); i++) {
+                Value *actual = CB->getArgOperand(i);
+                Argument *formal = F.getArg(i);
+                bool monotone = formal->getType()->isFloatTy()
+                                ? addFloatStep(domains[i], actual, formal)
+                                : addIntStep(domains[i], actual, formal, CB, SE);
+                if (!monotone) {
+                    return std::nullopt;
+                }
+            }
+        }
+        return domains;
+    }
+
+    // 按外部调用点的实参范围估计递归中出现的参数组合个数，决定表的大小
+    // 单调递减的参数从入口的值一直递归到终点，终点按SysY程序的习惯假定不大于0；
+    // 浮点参数、范围未知或步长不是常量时使用最大的表
+    unsigned getTableBits(Function &F, ArrayRef<ArgDomain> domains, ArrayRef<CallBase *> externalCalls,
+                          FunctionAnalysisManager &FAM) {
+        uint64_t combinations = 1;
+        for (unsigned i = 0; i < F.arg_size(); i++) {
+            const ArgDomain &domain = domains[i];
+            if (F.getArg(i)->getType()->isFloatTy() || !domain.stepKnown ||
+                (domain.increasing && !domain.decreasing)) {
+                return TableBits;
+            }
+            ConstantRange range = ConstantRange::getEmpty(32);
+            for (CallBase *CB: externalCalls) {
+                auto &SE = FAM.getResult<ScalarEvolutionAnalysis>(*CB->getFunction());
+                range = range.unionWith(SE.getSignedRange(SE.getSCEV(CB->getArgOperand(i))));
+            }
+            if (range.isFullSet() || range.isSignWrappedSet()) {
+                return TableBits;
+            }
+            int64_t low = range.getSignedMin().getSExtValue();
+            int64_t high = range.getSignedMax().getSExtValue();
+            if (domain.decreasing && !domain.increasing) {
+                low = std::min<int64_t>(low, 0);
+            }
+            combinations *= high - low + 1 + domain.maxStep + domain.constants;
+            if (combinations > (1u << TableBits)) {
+                return TableBits;
+            }
+        }
+        // 多个参数时按哈希值查找，留出一倍的空间减少冲突
+        unsigned bits = Log2_64_Ceil(combinations) + (F.arg_size() > 1 ? 1 : 0);
+        return std::min<unsigned>(std::max(bits, MinTableBits), TableBits);
+    }
+
+    // 判断函数是否适合记忆化：函数形式上满足要求，递归调用树中有大量重复的参数，
+    // 即有多个递归调用点（如fib(n - 1) + fib(n - 2)）或在循环中递归调用，并且参数单调变化
+    // 适合时返回表的大小（2的幂次）
+    std::optional<unsigned> isCandidate(Function &F, FunctionAnalysisManager &FAM) {
+        if (F.isDeclaration() || !F.hasLocalLinkage() || !isScalar(F.getReturnType()) ||
+            F.arg_empty() || F.arg_size() > MaxArgs) {
+            return std::nullopt;
+        }
+        for (const Argument &arg: F.args()) {
+            if (!isScalar(arg.getType())) {
+                return std::nullopt;
+            }
+        }
+
+        auto &LI = FAM.getResult<LoopAnalysis>(F);
+        unsigned selfCalls = 0;
+        bool callInLoop = false;
+        for (Instruction &I: instructions(F)) {
+            auto *CB = dyn_cast<CallBase>(&I);
+            if (CB && CB->getCalledFunction() == &F) {
+                selfCalls++;
+                callInLoop = callInLoop || LI.getLoopFor(CB->getParent());
+            }
+        }
+        if ((selfCalls < 2 && !callInLoop) || !isPure(F, &F, 0)) {
+            return std::nullopt;
+        }
+        // 外部的调用都已在编译期求值时，函数之后会被删除，不必记忆化
+        SmallVector<CallBase *, 4> externalCalls;
+        for (User *user: F.users()) {
+            auto *CB = dyn_cast<CallBase>(user);
+            if (CB && CB->getFunction() != &F) {
+                externalCalls.push_back(CB);
+            }
+        }
+        if (externalCalls.empty()) {
+            return std::nullopt;
+        }
+
+        auto domains = analyzeRecursion(F, FAM.getResult<ScalarEvolutionAnalysis>(F));
+        if (!domains) {
+            return std::nullopt;
+        }
+        return getTableBits(F, *domains, externalCalls, FAM);
+    }
+
+    void memoize(Function &F, unsigned tableBits) {
+        Module &M = *F.getParent();
+        LLVMContext &C = M.getContext();
+        Type *int32Ty = Type::getInt32Ty(C);
+
+        // 表项：{有效标记, 参数（浮点数按位保存为int）..., 返回值}
+        SmallVector<Type *, 5> fields{int32Ty};
+        fields.append(F.arg_size(), int32Ty);
+        fields.push_back(F.getReturnType());
+        auto *entryType = StructType::create(C, fields, (F.getName() + ".memo.entry").str());
+        auto *tableType = ArrayType::get(entryType, 1u << tableBits);
+        auto *table = new GlobalVariable(
+                M, tableType, false, GlobalValue::InternalLinkage,
+                ConstantAggregateZero::get(tableType), F.getName() + ".memo"
+        );
+        unsigned valueField = F.arg_size() + 1;
+
+        SmallVector<ReturnInst *, 4> returns;
+        for (BasicBlock &BB: F) {
+            if (auto *ret = dyn_cast<ReturnInst>(BB.getTerminator())) {
+                returns.push_back(ret);
+            }
+        }
+
+        BasicBlock *body = &F.getEntryBlock();
+        SmallVector<AllocaInst *, 4> allocas;
+        for (Instruction &I: *body) {
+            if (auto *alloca = dyn_cast<AllocaInst>(&I)) {
+                allocas.push_back(alloca);
+            }
+        }
+        auto *lookup = BasicBlock::Create(C, "memo.lookup", &F, body);
+        auto *hit = BasicBlock::Create(C, "memo.hit", &F, body);
+        // 局部数组的alloca留在入口块中
+        for (AllocaInst *alloca: allocas) {
+            alloca->moveBefore(*lookup, lookup->end());
+        }
+
+        // 只有一个整数参数时直接以参数的低位为下标，连续的参数不会冲突
+        IRBuilder<> builder(lookup);
+        SmallVector<Value *, 3> keys;
+        for (Argument &arg: F.args()) {
+            keys.push_back(builder.CreateBitCast(&arg, int32Ty));
+        }
+        Value *hash = keys[0];
+        for (unsigned i = 1; i < keys.size(); i++) {
+            hash = builder.CreateXor(builder.CreateMul(hash, builder.getInt32(HashMultiplier)), keys[i]);
+        }
+        if (keys.size() > 1 || F.getArg(0)->getType()->isFloatTy()) {
+            hash = builder.CreateXor(hash, builder.CreateLShr(hash, 16));
+        }
+        Value *index = builder.CreateAnd(hash, (1u << tableBits) - 1, "memo.index");
+        Value *entry = builder.CreateInBoundsGEP(tableType, table, {builder.getInt32(0), index}, "memo.entry");
+
+        Value *valid = builder.CreateLoad(int32Ty, builder.CreateStructGEP(entryType, entry, 0));
+        Value *found = builder.CreateICmpNE(valid, builder.getInt32(0));
+        for (unsigned i = 0; i < keys.size(); i++) {
+            Value *key = builder.CreateLoad(int32Ty, builder.CreateStructGEP(entryType, entry, i + 1));
+            found = builder.CreateAnd(found, builder.CreateICmpEQ(key, keys[i]));
+        }
+        builder.CreateCondBr(found, hit, body);
+
+        builder.SetInsertPoint(hit);
+        builder.CreateRet(builder.CreateLoad(
+                F.getReturnType(), builder.CreateStructGEP(entryType, entry, valueField), "memo.value"
+        ));
+
+        // 每次返回前记录结果，递归调用得到的结果同样会被记录
+        for (ReturnInst *ret: returns) {
+            builder.SetInsertPoint(ret);
+            for (unsigned i = 0; i < keys.size(); i++) {
+                builder.CreateStore(keys[i], builder.CreateStructGEP(entryType, entry, i + 1));
+            }
+            builder.CreateStore(ret->getReturnValue(), builder.CreateStructGEP(entryType, entry, valueField));
+            builder.CreateStore(builder.getInt32(1), builder.CreateStructGEP(entryType, entry, 0));
+        }
+    }
+}
+
+PreservedAnalyses MemoizePass::run(Module &M, ModuleAnalysisManager &AM) {
+    auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+
+    bool changed = false;
+    for (Function &F: M) {
+        auto tableBits = isCandidate(F, FAM);
+        if (!tableBits) {
+            continue;
+        }
+        log("memoize") << F.getName().str() << ": " << (1u << *tableBits) << " entries" << std::endl;
+        memoize(F, *tableBits);
+        FAM.invalidate(F, PreservedAnalyses::none());
+        NumMemoized++;
+        changed = true;
+    }
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
@@ -0,0 +1,15 @@
+#ifndef SYSY_COMPILER_PASSES_MEMOIZE_PASS_H
+#define SYSY_COMPILER_PASSES_MEMOIZE_PASS_H
+
+#include <llvm/IR/PassManager.h>
+
+// 为纯递归函数（参数和返回值都是int/float，只访问自己的局部变量，不调用有副作用的函数）加入记忆化：
+// 函数入口按参数的哈希值查找.bss中的直接映射表，命中时直接返回；每次返回前把结果写入表中
+// 只处理有多个递归调用点或在循环中递归调用、并且每个参数在递归中单调变化的函数，
+// 这类函数的递归调用树中有大量重复的参数；表的大小按外部调用点的实参范围估计
+class MemoizePass : public llvm::PassInfoMixin<MemoizePass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+};
+
+#endif //SYSY_COMPILER_PASSES_MEMOIZE_PASS_H
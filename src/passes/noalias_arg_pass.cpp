@@ -0,0 +1,117 @@
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Module.h>
+#include "log.h"
+#include "sysy_alias_analysis.h"
+#include "noalias_arg_pass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "noalias-arg"
+
+STATISTIC(NumNoAlias, "Number of arguments marked noalias");
+
+using GlobalSet = SmallPtrSet<const GlobalVariable *, 8>;
+
+// 收集常量表达式中引用的全局变量（例如InstCombine折叠出的常量GEP）
+static void collectGlobals(const Value *V, GlobalSet &globals) {
+    if (auto *GV = dyn_cast<GlobalVariable>(V)) {
+        globals.insert(GV);
+    } else if (auto *CE = dyn_cast<ConstantExpr>(V)) {
+        for (const Value *op: CE->operands()) {
+            collectGlobals(op, globals);
+        }
+    }
+}
+
+// 计算每个函数直接或间接（经由被调函数）引用的全局变量
+// 外部函数即SysY运行时库，不会访问用户的全局变量
+static DenseMap<const Function *, GlobalSet> computeUsedGlobals(Module &M) {
+    DenseMap<const Function *, GlobalSet> usedGlobals;
+    for (Function &F: M) {
+        GlobalSet &globals = usedGlobals[&F];
+        for (Instruction &I: instructions(F)) {
+            for (const Value *op: I.operands()) {
+                collectGlobals(op, globals);
+            }
+        }
+    }
+
+    // 沿调用图传播直到不动点
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Function &F: M) {
+            for (Instruction &I: instructions(F)) {
+                auto *CB = dyn_cast<CallBase>(&I);
+                if (!CB || !CB->getCalledFunction()) {
+                    continue;
+                }
+                const Function *callee = CB->getCalledFunction();
+                if (callee == &F) {
+                    continue;
+                }
+                // 拷贝一份，避免DenseMap扩容导致引用失效
+                GlobalSet calleeGlobals = usedGlobals[callee];
+                GlobalSet &globals = usedGlobals[&F];
+                for (const GlobalVariable *GV: calleeGlobals) {
+                    changed |= globals.insert(GV).second;
+                }
+            }
+        }
+    }
+    return usedGlobals;
+}
+
+PreservedAnalyses NoAliasArgPass::run(Module &M, ModuleAnalysisManager &AM) {
+    auto &argPointsTo = AM.getResult<ArgPointsToAnalysis>(M);
+    auto usedGlobals = computeUsedGlobals(M);
+
+    bool changed = false;
+    for (Function &F: M) {
+        for (Argument &arg: F.args()) {
+            auto *objects = argPointsTo.getPointsTo(&arg);
+            if (!objects || arg.hasNoAliasAttr()) {
+                continue;
+            }
+
+            // 函数内不能通过其他途径访问到该参数指向的对象：
+            // 其他指针参数的指向集合与之不相交，且函数（及其被调函数）不直接引用这些全局变量
+            bool noAlias = llvm::all_of(F.args(), [&](Argument &other) {
+                if (&other == &arg || !other.getType()->isPointerTy()) {
+                    return true;
+                }
+                auto *otherObjects = argPointsTo.getPointsTo(&other);
+                return otherObjects && llvm::none_of(*objects, [&](const Value *obj) {
+                    return otherObjects->count(obj);
+                });
+            });
+            noAlias = noAlias && llvm::none_of(*objects, [&](const Value *obj) {
+                auto *GV = dyn_cast<GlobalVariable>(obj);
+                return GV && usedGlobals[&F].count(GV);
+            });
+
+            if (noAlias) {
+                log("noalias") << F.getName().str() << ": " << arg.getName().str() << std::endl;
+                arg.addAttr(Attribute::NoAlias);
+                ++NumNoAlias;
+                changed = true;
+            }
+        }
+    }
+
+    if (!changed) {
+        return PreservedAnalyses::all();
+    }
+
+    // 只添加了属性，参数的指向关系没有变化
+    PreservedAnalyses PA;
+    PA.preserve<ArgPointsToAnalysis>();
+    return PA;
+}
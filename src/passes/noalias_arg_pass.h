@@ -0,0 +1,12 @@
+#ifndef SYSY_COMPILER_PASSES_NOALIAS_ARG_PASS_H
+#define SYSY_COMPILER_PASSES_NOALIAS_ARG_PASS_H
+
+#include <llvm/IR/PassManager.h>
+
+// 根据全程序的调用点分析，为互不相交的数组参数添加noalias属性
+class NoAliasArgPass : public llvm::PassInfoMixin<NoAliasArgPass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+};
+
+#endif //SYSY_COMPILER_PASSES_NOALIAS_ARG_PASS_H
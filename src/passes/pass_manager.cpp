@@ -1,44 +1,130 @@
+#include <optional>
+#include <stdexcept>
+#include <llvm/IR/DiagnosticInfo.h>
+#include <llvm/IR/DiagnosticPrinter.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/Passes/PassBuilder.h>
-#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/CommandLine.h>
 #include <llvm/Support/FileSystem.h>
-#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/Regex.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Target/TargetMachine.h>
+#include <llvm/Transforms/InstCombine/InstCombine.h>
+#include <llvm/Transforms/Scalar/DivRemPairs.h>
+#include <llvm/Transforms/Scalar/EarlyCSE.h>
+#include <llvm/Transforms/Scalar/GVN.h>
+#include <llvm/Transforms/Scalar/LICM.h>
+#include <llvm/Transforms/Scalar/LoopIdiomRecognize.h>
+#include <llvm/Transforms/Scalar/LoopInstSimplify.h>
+#include <llvm/Transforms/Scalar/LoopRotation.h>
+#include <llvm/Transforms/Scalar/SimpleLoopUnswitch.h>
+#include <llvm/Transforms/Scalar/SimplifyCFG.h>
+#include <llvm/Transforms/Scalar/TailRecursionElimination.h>
+#include <llvm/Transforms/Vectorize/LoopVectorize.h>
+#include <llvm/Transforms/Vectorize/SLPVectorizer.h>
 #include "IR.h"
+#include "const_call_eval_pass.h"
+#include "function_attr_infer_pass.h"
+#include "global_layout_pass.h"
+#include "global_localize_pass.h"
+#include "global_mod_ref_analysis.h"
 #include "hello_world_pass.h"
+#include "inline_pass.h"
+#include "loop_deletion.h"
+#include "loop_fusion_pass.h"
+#include "loop_nest_pass.h"
+#include "loop_parallelize_pass.h"
+#include "loop_peel_pass.h"
+#include "matmul_pass.h"
+#include "memoize_pass.h"
 #include "mem2reg_pass.h"
+#include "noalias_arg_pass.h"
 #include "pass_manager.h"
+#include "precompute_pass.h"
+#include "prefetch_pass.h"
+#include "sysy_alias_analysis.h"
+#include "target_machine.h"
+#include "unroll_and_jam_pass.h"
+#include "unroll_pass.h"
 #include <llvm/CodeGen/RegAllocRegistry.h>
 
+// 将pass名称与-Rpass*选项匹配的优化备注输出到标准错误
+// 源程序没有调试信息，备注以函数名代替源码位置
+class RemarkHandler : public llvm::DiagnosticHandler {
+    std::optional<llvm::Regex> passed;
+    std::optional<llvm::Regex> missed;
+    std::optional<llvm::Regex> analysis;
+
+    static std::optional<llvm::Regex> compile(const std::string &pattern) {
+        if (pattern.empty()) {
+            return std::nullopt;
+        }
+        llvm::Regex regex(pattern);
+        std::string error;
+        if (!regex.isValid(error)) {
+            throw std::invalid_argument("invalid remark pattern " + pattern + ": " + error);
+        }
+        return regex;
+    }
+
+    static bool match(const std::optional<llvm::Regex> &regex, llvm::StringRef passName) {
+        return regex && regex->match(passName);
+    }
+
+public:
+    explicit RemarkHandler(const RemarkOptions &options)
+            : passed(compile(options.passed)),
+              missed(compile(options.missed)),
+              analysis(compile(options.analysis)) {}
+
+    bool isPassedOptRemarkEnabled(llvm::StringRef passName) const override {
+        return match(passed, passName);
+    }
+
+    bool isMissedOptRemarkEnabled(llvm::StringRef passName) const override {
+        return match(missed, passName);
+    }
+
+    bool isAnalysisRemarkEnabled(llvm::StringRef passName) const override {
+        return match(analysis, passName);
+    }
+
+    bool isAnyRemarkEnabled() const override {
+        return passed || missed || analysis;
+    }
+
+    bool handleDiagnostics(const llvm::DiagnosticInfo &DI) override {
+        auto *remark = llvm::dyn_cast<llvm::DiagnosticInfoOptimizationBase>(&DI);
+        if (!remark) {
+            return false;
+        }
+        if (remark->isEnabled()) {
+            llvm::errs() << remark->getFunction().getName() << ": remark: "
+                         << remark->getMsg() << " [" << remark->getPassName() << "]\n";
+        }
+        return true;
+    }
+};
+
+// 设置LLVM选项的默认值，已经用-mllvm指定的选项保持不变
+static void setDefaultOption(llvm::StringRef name, llvm::StringRef value) {
+    auto &options = llvm::cl::getRegisteredOptions();
+    auto it = options.find(name);
+    if (it != options.end() && it->second->getNumOccurrences() == 0) {
+        it->second->addOccurrence(0, name, value);
+    }
+}
+
 // 使用llvm的新pass manager
 // https://llvm.org/docs/NewPassManager.html
-void PassManager::run(int optLevel, const std::string &filename) {
-
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargets();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllAsmPrinters();
-
-    std::string err;
-    auto triple = "arm-unknown-linux-gnu";
-    auto target = llvm::TargetRegistry::lookupTarget(triple, err);
-    if (!target) {
-        throw std::logic_error(err);
-    }
+void PassManager::run(int optLevel, const std::string &filename,
+                      const TargetOptions &targetOptions, const RemarkOptions &remarkOptions) {
 
-    auto CPU = "generic";
-    auto features = "";
-    llvm::TargetOptions opt;
-#ifdef CONF_HARD_FLOAT
-    opt.FloatABIType = llvm::FloatABI::Hard;
-#endif
-    auto targetMachine =
-            target->createTargetMachine(triple, CPU, features, opt, {});
+    auto targetMachine = createTargetMachine(targetOptions);
+    IR::ctx.llvmCtx.setDiagnosticHandler(std::make_unique<RemarkHandler>(remarkOptions));
 
     IR::ctx.module.setDataLayout(targetMachine->createDataLayout());
-    IR::ctx.module.setTargetTriple(triple);
+    IR::ctx.module.setTargetTriple(targetMachine->getTargetTriple().str());
 
     if (optLevel != 0) {
         llvm::LoopAnalysisManager LAM;
@@ -46,7 +132,19 @@ void PassManager::run(int optLevel, const std::string &filename) {
         llvm::CGSCCAnalysisManager CGAM;
         llvm::ModuleAnalysisManager MAM;
 
-        llvm::PassBuilder PB(targetMachine);
+        llvm::PassBuilder PB(targetMachine.get());
+
+        // 在默认的别名分析之后加入SysY语义的别名分析和过程间的全局变量读写摘要
+        // 必须在registerFunctionAnalyses之前注册，否则会被默认的AAManager占位
+        FAM.registerPass([&] {
+            llvm::AAManager AA = PB.buildDefaultAAPipeline();
+            AA.registerFunctionAnalysis<SysYAA>();
+            AA.registerModuleAnalysis<GlobalModRefAnalysis>();
+            return AA;
+        });
+        FAM.registerPass([] { return SysYAA(); });
+        MAM.registerPass([] { return ArgPointsToAnalysis(); });
+        MAM.registerPass([] { return GlobalModRefAnalysis(); });
 
         PB.registerModuleAnalyses(MAM);
         PB.registerCGSCCAnalyses(CGAM);
@@ -54,20 +152,120 @@ void PassManager::run(int optLevel, const std::string &filename) {
         PB.registerLoopAnalyses(LAM);
         PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
 
-        // 在优化管道前端加入自己的pass
-        PB.registerPipelineStartEPCallback(
-                [&](llvm::ModulePassManager &MPM, llvm::OptimizationLevel level) {
-                    MPM.addPass(llvm::createModuleToFunctionPassAdaptor(HelloWorldPass()));
-                    MPM.addPass(llvm::createModuleToFunctionPassAdaptor(llvm::PromotePass()));
-                }
-        );
+        // 使用自己组装的优化管道
+        llvm::ModulePassManager MPM;
+        MPM.addPass(llvm::createModuleToFunctionPassAdaptor(HelloWorldPass()));
+        // -sysy-unroll-function指定的展开次数在任何函数被内联或删除之前转换为循环上的元数据
+        MPM.addPass(UnrollFunctionCountPass());
+        // 在mem2reg之前将只在main中使用的全局变量转换为局部变量，使其也能被提升
+        MPM.addPass(GlobalLocalizePass());
+        MPM.addPass(llvm::createModuleToFunctionPassAdaptor(llvm::PromotePass()));
+        // 留在全局的变量的布局：数组对齐与行填充、标量按使用频率排列，
+        // 在其他优化之前进行，此时数组的使用还是前端生成的下标访问
+        MPM.addPass(GlobalLayoutPass(*targetMachine));
+
+        // 整个程序的预计算（-mllvm -precompute）：不读取输入的程序在编译期执行完毕，只保留输出
+        MPM.addPass(PrecomputePass());
+
+        // 编译期求值实参全为常量的纯函数调用，需要在记忆化之前进行（记忆化的函数会写全局的表）
+        MPM.addPass(ConstCallEvalPass());
+
+        // 纯递归函数的记忆化：在尾递归消除之前进行，此时递归调用的结构（调用点个数）还是源程序的样子
+        MPM.addPass(MemoizePass());
+
+        // 尾递归消除：自身的尾调用改写为循环；递归结果与满足结合律、交换律的运算组合时
+        // （如return n + f(n - 1)）引入累加器phi后同样改写为循环
+        // 在内联之前进行，消除递归后的函数不再处于调用图的环中，可以被内联
+        MPM.addPass(llvm::createModuleToFunctionPassAdaptor(llvm::TailCallElimPass()));
+
+        // 内联小函数，省去调用开销并让调用点的上下文参与之后的优化
+        MPM.addPass(InlinePass());
+
+        // 推导函数属性，使纯函数调用能够参与CSE、LICM和死代码删除
+        MPM.addPass(FunctionAttrInferPass());
+
+        // 提升为SSA后数组参数的来源才清晰，此时进行全程序的参数指向分析
+        MPM.addPass(NoAliasArgPass());
+        MPM.addPass(llvm::RequireAnalysisPass<ArgPointsToAnalysis, llvm::Module>());
+        MPM.addPass(llvm::RequireAnalysisPass<GlobalModRefAnalysis, llvm::Module>());
 
-//        llvm::ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(
-//                llvm::OptimizationLevel::O3
-//        );
+        // 标量优化，GVN和LICM借助别名分析消除冗余的load/store
+        llvm::FunctionPassManager FPM;
+        FPM.addPass(llvm::InstCombinePass());
+        FPM.addPass(llvm::SimplifyCFGPass());
+        FPM.addPass(llvm::EarlyCSEPass(true));
+        FPM.addPass(llvm::GVNPass());
+
+        // 矩阵乘法替换为运行时库的kernel（-mllvm -matmul-kernel），需要未旋转的循环，
+        // 并且在循环嵌套的交换之前进行，此时各层循环还是源程序的样子
+        FPM.addPass(MatmulPass());
+
+        // 相邻的迭代次数相同的循环合并，同样需要未旋转的循环；合并后的循环嵌套再参与之后的交换与分块
+        FPM.addPass(LoopFusionPass());
+
+        // 循环嵌套的交换与分块，需要旋转后的循环，并且在LICM把数组元素提升为寄存器之前进行
+        // 旋转后外层latch中会留下两个入边值相同的phi，先化简掉，归纳变量才能被识别
+        llvm::LoopPassManager rotateLPM;
+        rotateLPM.addPass(llvm::LoopRotatePass());
+        rotateLPM.addPass(llvm::LoopInstSimplifyPass());
+        FPM.addPass(llvm::createFunctionToLoopPassAdaptor(std::move(rotateLPM)));
+        FPM.addPass(LoopNestPass(*targetMachine));
+
+        llvm::LoopPassManager LPM;
+        // 旋转为do-while形式后循环体内的store必定执行，LICM才能把全局变量提升到寄存器；重新生成的循环嵌套同样需要旋转
+        LPM.addPass(llvm::LoopRotatePass());
+        // load移到preheader、store下沉到出口，嵌套外层移到最内层的计算移回外层
+        LPM.addPass(llvm::LICMPass());
+        // 以LICM移出的不变量为条件的分支移到循环外，两个分支各一份循环，规模受-unswitch-threshold限制
+        LPM.addPass(llvm::SimpleLoopUnswitchPass(true));
+        // 数组的清零、填充（包括-1和0x3f3f3f3f之类的"无穷大"）和复制循环改写为memset/memcpy
+        LPM.addPass(llvm::LoopIdiomRecognizePass());
+        // 循环外使用的值由SCEV改写为闭式（计数、等差数列求和），之后没有副作用的循环被删除，内层先于外层
+        LPM.addPass(llvm::LoopDeletionPass());
+        FPM.addPass(llvm::createFunctionToLoopPassAdaptor(std::move(LPM), true));
+        // 剥离第一次或最后一次迭代，去掉循环中只与归纳变量是否等于首末值有关的分支
+        FPM.addPass(LoopPeelPass());
+
+        // 外层循环的展开合并，在LICM之后进行，此时内层循环中累加到数组元素上的值已被提升为寄存器中的归约
+        // LICM提到各层循环外的保护条件是相同的比较，先由GVN合并并删去被外层条件蕴含的分支，
+        // 内层循环才能在外层的每次迭代中无条件地进入
+        FPM.addPass(llvm::GVNPass());
+        FPM.addPass(llvm::SimplifyCFGPass());
+        FPM.addPass(UnrollAndJamPass());
+        MPM.addPass(llvm::createModuleToFunctionPassAdaptor(std::move(FPM)));
+
+        // 自动并行化（-mllvm -auto-parallel）：在向量化之前进行，提取出的循环体函数也会被向量化
+        // 提取出的函数改变了调用关系，过程间的分析只能显式失效，之后重新计算
+        MPM.addPass(LoopParallelizePass());
+        MPM.addPass(llvm::InvalidateAnalysisPass<GlobalModRefAnalysis>());
+        MPM.addPass(llvm::InvalidateAnalysisPass<ArgPointsToAnalysis>());
+        MPM.addPass(llvm::RequireAnalysisPass<ArgPointsToAnalysis, llvm::Module>());
+        MPM.addPass(llvm::RequireAnalysisPass<GlobalModRefAnalysis, llvm::Module>());
+
+        llvm::FunctionPassManager lateFPM;
+        // 向量化：只有目标支持NEON（-mcpu=cortex-a*或-mfpu=neon*，且不是软件浮点）时才会生效，
+        // 向量宽度和收益由ARM的TTI按所选CPU的代价模型决定
+        // ARMv7的NEON浮点运算不完全符合IEEE 754，浮点循环不会被向量化
+        lateFPM.addPass(llvm::LoopVectorizePass());
+        lateFPM.addPass(llvm::InstCombinePass());
+        // 循环展开在向量化之后进行，避免展开后的循环无法向量化；迭代次数为小常量的循环完全展开后
+        // 成为直线代码，下标变为常量，由InstCombine化简后再交给SLP向量化
+        lateFPM.addPass(UnrollPass());
+        lateFPM.addPass(llvm::InstCombinePass());
+        // 软件预取在展开之后进行，按展开后的循环体大小计算提前量，参数按-mcpu=选择的CPU查表
+        lateFPM.addPass(PrefetchPass(*targetMachine));
+        lateFPM.addPass(llvm::SLPVectorizerPass());
+
+        // 除以常量由后端的DAGCombiner展开为smull乘高位+移位（2的幂为移位+掩码），不需要在IR上处理
+        // 除数不是常量时，同时出现的a / b和a % b将余数改写为a - (a / b) * b，
+        // 没有硬件除法时省去一次__modsi3库调用，有硬件除法时（ARM没有取余指令）生成sdiv+mls
+        lateFPM.addPass(llvm::DivRemPairsPass());
+        lateFPM.addPass(llvm::InstCombinePass());
+        lateFPM.addPass(llvm::SimplifyCFGPass());
+        MPM.addPass(llvm::createModuleToFunctionPassAdaptor(std::move(lateFPM)));
 
         log("PM") << "optimizing module" << std::endl;
-        //MPM.run(IR::ctx.module, MAM);
+        MPM.run(IR::ctx.module, MAM);
 
         // 展示优化后的IR
         IR::show();
@@ -80,6 +278,13 @@ void PassManager::run(int optLevel, const std::string &filename) {
         throw std::runtime_error("Could not open file: " + EC.message());
     }
 
+    // 后端的LoopStrengthReduce把由归纳变量计算的数组地址（如a[i][j]的base + i * stride + j * 4）
+    // 改写为每次迭代递增的指针。LLVM只对M系列CPU优先选择后变址寻址，这里对所有ARM CPU都如此：
+    // 指针在访存之后递增，由指令选择合并为ldr r0, [r1], #4；候选方案按预期的寄存器数缩减，
+    // 循环中同时活跃的归纳变量更少，基本寄存器分配器在循环内的溢出也随之减少
+    setDefaultOption("lsr-preferred-addressing-mode", "postindexed");
+    setDefaultOption("lsr-exp-narrow", "true");
+
     log("PM") << "generate assembly" << std::endl;
     llvm::RegisterRegAlloc::setDefault(llvm::createBasicRegisterAllocator);
     llvm::legacy::PassManager codeGenPass;
@@ -2,9 +2,19 @@
 #define SYSY_COMPILER_PASSES_PASS_MANAGER_H
 
 #include <llvm/Passes/PassBuilder.h>
+#include "target_machine.h"
+
+// 优化备注选项，对应命令行的-Rpass=、-Rpass-missed=、-Rpass-analysis=，含义与clang相同
+// 值为pass名称的正则表达式，例如-Rpass-missed=loop-vectorize输出未能向量化的循环及原因
+struct RemarkOptions {
+    std::string passed;
+    std::string missed;
+    std::string analysis;
+};
 
 namespace PassManager {
-    void run(int optLevel, const std::string &filename);
+    void run(int optLevel, const std::string &filename,
+             const TargetOptions &targetOptions, const RemarkOptions &remarkOptions);
 }
 
 #endif //SYSY_COMPILER_PASSES_PASS_MANAGER_H
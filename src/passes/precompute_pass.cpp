@@ -0,0 +1,266 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Analysis/CallGraph.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CommandLine.h>
+#include "log.h"
+#include "ir_interpreter.h"
+#include "precompute_pass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "precompute"
+
+STATISTIC(NumPrecomputed, "Number of programs precomputed");
+
+static cl::opt<bool> EnablePrecompute(
+        "precompute", cl::init(false),
+        cl::desc("Run input-free programs at compile time and emit their output"));
+
+static cl::opt<unsigned> PrecomputeFuel(
+        "precompute-fuel", cl::init(10000000), cl::Hidden,
+        cl::desc("Max IR instructions interpreted when precomputing a program"));
+
+// 全局变量和局部数组都要在解释器中分配内存，递归函数的局部数组在每一层调用中各有一份
+static cl::opt<unsigned> MemoryLimit(
+        "precompute-memory-limit", cl::init(256 << 20), cl::Hidden,
+        cl::desc("Max total size in bytes of global variables and local arrays of a precomputed program"));
+
+// 输出保存在生成的程序中，过长的输出会使程序体积过大
+static cl::opt<unsigned> OutputLimit(
+        "precompute-output-limit", cl::init(1 << 20), cl::Hidden,
+        cl::desc("Max bytes of output of a precomputed program"));
+
+namespace {
+
+    // 程序运行中的一个事件：一段输出，或者一次计时函数调用
+    struct Event {
+        enum Kind {
+            Output,
+            StartTime,
+            StopTime
+        } kind;
+        std::string text;
+        int lineno = 0;
+    };
+
+    // 执行整个程序的解释器：允许读写所有全局变量，输出函数和计时函数的调用被记录下来
+    class ProgramInterpreter : public IRInterpreter {
+    public:
+        std::vector<Event> events;
+
+        ProgramInterpreter(const DataLayout &DL, uint64_t fuel, uint64_t memoryLimit)
+                : IRInterpreter(DL, fuel, memoryLimit) {}
+
+    protected:
+        bool canAccessGlobal(const GlobalVariable &GV, bool write) override {
+            return !write || !GV.isConstant();
+        }
+
+        bool callExternal(const CallBase &CB, ArrayRef<Value> args, Value &result) override {
+            StringRef name = CB.getCalledFunction()->getName();
+            if (name == "putint") {
+                return output(std::to_string((int) args[0].i));
+            }
+            if (name == "putch") {
+                return output(std::string(1, (char) args[0].i));
+            }
+            if (name == "putfloat") {
+                return output(formatFloat(args[0].f));
+            }
+            if (name == "putarray" || name == "putfarray") {
+                // 与运行时库的格式相同："n: a[0] a[1] ...\n"
+                int n = (int) args[0].i;
+                std::string text = std::to_string(n) + ":";
+                for (int i = 0; i < n; i++) {
+                    Value pointer = args[1];
+                    pointer.offset += 4 * i;
+                    uint8_t *data = access(pointer, 4, false);
+                    if (!data) {
+                        return false;
+                    }
+                    if (name == "putarray") {
+                        int value;
+                        std::memcpy(&value, data, 4);
+                        text += " " + std::to_string(value);
+                    } else {
+                        float value;
+                        std::memcpy(&value, data, 4);
+                        text += " " + formatFloat(value);
+                    }
+                }
+                return output(text + "\n");
+            }
+            if (name == "_sysy_starttime" || name == "_sysy_stoptime") {
+                Event event{name == "_sysy_starttime" ? Event::StartTime : Event::StopTime};
+                event.lineno = (int) args[0].i;
+                events.push_back(event);
+                return true;
+            }
+            // 输入函数的结果在编译期未知
+            return false;
+        }
+
+    private:
+        uint64_t outputSize = 0;
+
+        static std::string formatFloat(float value) {
+            char buffer[64];
+            std::snprintf(buffer, sizeof(buffer), "%a", value);
+            return buffer;
+        }
+
+        bool output(const std::string &text) {
+            outputSize += text.size();
+            if (outputSize > OutputLimit) {
+                return false;
+            }
+            if (events.empty() || events.back().kind != Event::Output) {
+                events.push_back({Event::Output});
+            }
+            events.back().text += text;
+            return true;
+        }
+    };
+
+    // 判断从main出发能否调用到输入函数
+    bool mayReadInput(Module &M, Function *main) {
+        static const StringSet<> inputFunctions{"getint", "getch", "getfloat", "getarray", "getfarray"};
+        CallGraph CG(M);
+        SmallPtrSet<const CallGraphNode *, 16> visited;
+        SmallVector<const CallGraphNode *, 16> worklist{CG[main]};
+        while (!worklist.empty()) {
+            const CallGraphNode *node = worklist.pop_back_val();
+            if (!visited.insert(node).second) {
+                continue;
+            }
+            const Function *F = node->getFunction();
+            // 外部调用节点代表无法确定的被调函数
+            if (!F) {
+                return true;
+            }
+            if (F->isDeclaration()) {
+                if (inputFunctions.count(F->getName())) {
+                    return true;
+                }
+                continue;
+            }
+            for (auto &record: *node) {
+                worklist.push_back(record.second);
+            }
+        }
+        return false;
+    }
+
+    // 生成输出一段文本的调用，putf以文本为格式串，其中的%需要转义，'\0'只能用putch输出
+    void emitOutput(IRBuilder<> &builder, FunctionCallee putf, FunctionCallee putch, StringRef text) {
+        while (!text.empty()) {
+            size_t end = text.find('\0');
+            StringRef segment = text.substr(0, end);
+            if (!segment.empty()) {
+                std::string format;
+                for (char c: segment) {
+                    format += c;
+                    if (c == '%') {
+                        format += '%';
+                    }
+                }
+                builder.CreateCall(putf, builder.CreateGlobalStringPtr(format, "precompute.output"));
+            }
+            if (end == StringRef::npos) {
+                break;
+            }
+            builder.CreateCall(putch, builder.getInt32(0));
+            text = text.substr(end + 1);
+        }
+    }
+}
+
+PreservedAnalyses PrecomputePass::run(Module &M, ModuleAnalysisManager &AM) {
+    Function *main = M.getFunction("main");
+    if (!EnablePrecompute || !main || main->isDeclaration() || !main->arg_empty() || mayReadInput(M, main)) {
+        return PreservedAnalyses::all();
+    }
+
+    const DataLayout &DL = M.getDataLayout();
+    uint64_t memory = 0;
+    for (GlobalVariable &GV: M.globals()) {
+        memory += DL.getTypeAllocSize(GV.getValueType());
+    }
+    if (memory > MemoryLimit) {
+        log("precompute") << "globals too large: " << memory << " bytes" << std::endl;
+        return PreservedAnalyses::all();
+    }
+
+    ProgramInterpreter interpreter(DL, PrecomputeFuel, MemoryLimit);
+    IRInterpreter::Value exitCode;
+    if (!interpreter.call(*main, {}, exitCode)) {
+        log("precompute") << "failed after " << PrecomputeFuel - interpreter.getRemainingFuel()
+                          << " steps" << std::endl;
+        return PreservedAnalyses::all();
+    }
+    log("precompute") << "finished in " << PrecomputeFuel - interpreter.getRemainingFuel()
+                      << " steps, exit code " << (int) exitCode.i << std::endl;
+
+    // 用输出结果替换main的函数体
+    LLVMContext &C = M.getContext();
+    FunctionCallee putf = M.getOrInsertFunction(
+            "putf", FunctionType::get(Type::getVoidTy(C), {Type::getInt8PtrTy(C)}, true)
+    );
+    FunctionCallee putch = M.getOrInsertFunction("putch", Type::getVoidTy(C), Type::getInt32Ty(C));
+    FunctionCallee startTime = M.getOrInsertFunction("_sysy_starttime", Type::getVoidTy(C), Type::getInt32Ty(C));
+    FunctionCallee stopTime = M.getOrInsertFunction("_sysy_stoptime", Type::getVoidTy(C), Type::getInt32Ty(C));
+
+    auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    FAM.clear(*main, main->getName());
+    main->dropAllReferences();
+    IRBuilder<> builder(BasicBlock::Create(C, "entry", main));
+    for (const Event &event: interpreter.events) {
+        switch (event.kind) {
+            case Event::Output:
+                emitOutput(builder, putf, putch, event.text);
+                break;
+            case Event::StartTime:
+                builder.CreateCall(startTime, builder.getInt32(event.lineno));
+                break;
+            case Event::StopTime:
+                builder.CreateCall(stopTime, builder.getInt32(event.lineno));
+                break;
+        }
+    }
+    builder.CreateRet(IRInterpreter::toConstant(exitCode, main->getReturnType()));
+
+    // 其余的函数和全局变量都不再被使用
+    SmallVector<Function *, 16> deadFunctions;
+    for (Function &F: M) {
+        if (&F != main && !F.isDeclaration() && F.hasLocalLinkage()) {
+            deadFunctions.push_back(&F);
+        }
+    }
+    for (Function *F: deadFunctions) {
+        FAM.clear(*F, F->getName());
+        F->dropAllReferences();
+    }
+    for (Function *F: deadFunctions) {
+        F->eraseFromParent();
+    }
+    SmallVector<GlobalVariable *, 16> deadGlobals;
+    for (GlobalVariable &GV: M.globals()) {
+        if (GV.hasLocalLinkage() && GV.use_empty()) {
+            deadGlobals.push_back(&GV);
+        }
+    }
+    for (GlobalVariable *GV: deadGlobals) {
+        GV->eraseFromParent();
+    }
+
+    NumPrecomputed++;
+    return PreservedAnalyses::none();
+}
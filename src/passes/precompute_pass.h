@@ -0,0 +1,15 @@
+#ifndef SYSY_COMPILER_PASSES_PRECOMPUTE_PASS_H
+#define SYSY_COMPILER_PASSES_PRECOMPUTE_PASS_H
+
+#include <llvm/IR/PassManager.h>
+
+// 整个程序的预计算：从main出发不会调用任何输入函数的程序，其输出是确定的
+// 在编译期用IR解释器执行整个程序，记录标准输出、计时函数的调用顺序和main的返回值，
+// 然后将main替换为直接输出这些结果的代码；超出步数、内存或输出长度限制时保持原样
+// 默认关闭，使用 -mllvm -precompute 开启
+class PrecomputePass : public llvm::PassInfoMixin<PrecomputePass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+};
+
+#endif //SYSY_COMPILER_PASSES_PRECOMPUTE_PASS_H
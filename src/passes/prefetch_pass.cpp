@@ -0,0 +1,153 @@
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/CodeMetrics.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
+#include "log.h"
+#include "prefetch_pass.h"
+#include "target_machine.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "sysy-prefetch"
+
+STATISTIC(NumPrefetches, "Number of prefetches inserted");
+
+// 循环体很小时提前量很大，迭代次数不多的循环中大部分预取都落在数组之外
+static cl::opt<unsigned> MaxItersAhead(
+        "sysy-prefetch-max-iters-ahead", cl::init(16), cl::Hidden,
+        cl::desc("Max number of iterations to prefetch ahead"));
+
+namespace {
+
+    // 一组在同一cache行内的访问，预取插在第一个访问之前
+    struct PrefetchGroup {
+        const SCEVAddRecExpr *addr;
+        Instruction *insertPt;
+        bool write;
+    };
+
+} // namespace
+
+// 能放进L1 cache的数组在第一次遍历后就留在cache中，不需要预取
+static bool fitsInCache(Value *ptr, const CPUCacheInfo &info, const DataLayout &DL) {
+    const Value *object = getUnderlyingObject(ptr);
+    Type *type = nullptr;
+    if (auto *GV = dyn_cast<GlobalVariable>(object)) {
+        type = GV->getValueType();
+    } else if (auto *AI = dyn_cast<AllocaInst>(object); AI && AI->isStaticAlloca()) {
+        type = AI->getAllocatedType();
+    }
+    return type && DL.getTypeAllocSize(type) <= info.L1Size;
+}
+
+static bool insertPrefetches(Loop *L, const CPUCacheInfo &info, bool hasPLDW, ScalarEvolution &SE,
+                             AssumptionCache &AC, const TargetTransformInfo &TTI) {
+    BasicBlock *header = L->getHeader();
+    const DataLayout &DL = header->getModule()->getDataLayout();
+    if (!L->getLoopPreheader()) {
+        return false;
+    }
+
+    SmallPtrSet<const Value *, 32> ephValues;
+    CodeMetrics::collectEphemeralValues(L, &AC, ephValues);
+    CodeMetrics metrics;
+    for (BasicBlock *BB: L->blocks()) {
+        metrics.analyzeBasicBlock(BB, TTI, ephValues);
+    }
+    unsigned itersAhead = std::clamp(info.prefetchDistance / std::max(metrics.NumInsts, 1u), 1u,
+                                     std::max<unsigned>(MaxItersAhead, 1));
+    unsigned maxTripCount = SE.getSmallConstantMaxTripCount(L);
+    if (maxTripCount && maxTripCount <= itersAhead) {
+        return false;
+    }
+
+    SmallVector<PrefetchGroup, 8> groups;
+    for (BasicBlock *BB: L->blocks()) {
+        for (Instruction &I: *BB) {
+            if (!isa<LoadInst>(I) && !isa<StoreInst>(I)) {
+                continue;
+            }
+            Value *ptr = getLoadStorePointerOperand(&I);
+            auto *addr = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(ptr));
+            if (!addr || addr->getLoop() != L || !addr->isAffine()) {
+                continue;
+            }
+            auto *step = dyn_cast<SCEVConstant>(addr->getStepRecurrence(SE));
+            if (!step || step->getAPInt().abs().ult(info.prefetchMinStride) || fitsInCache(ptr, info, DL)) {
+                continue;
+            }
+            auto it = find_if(groups, [&](const PrefetchGroup &G) {
+                auto *diff = dyn_cast<SCEVConstant>(SE.getMinusSCEV(addr, G.addr));
+                return diff && diff->getAPInt().abs().ult(info.lineSize);
+            });
+            if (it != groups.end()) {
+                it->write |= isa<StoreInst>(I);
+            } else {
+                groups.push_back({addr, &I, isa<StoreInst>(I)});
+            }
+        }
+    }
+
+    SCEVExpander expander(SE, DL, "prefetch");
+    unsigned inserted = 0;
+    for (const PrefetchGroup &G: groups) {
+        const SCEV *step = G.addr->getStepRecurrence(SE);
+        const SCEV *next = SE.getAddExpr(G.addr, SE.getMulExpr(SE.getConstant(step->getType(), itersAhead), step));
+        if (!isSafeToExpand(next, SE)) {
+            continue;
+        }
+        unsigned addrSpace = G.addr->getType()->getPointerAddressSpace();
+        Value *ptr = expander.expandCodeFor(next, Type::getInt8PtrTy(header->getContext(), addrSpace), G.insertPt);
+        IRBuilder<> builder(G.insertPt);
+        Function *prefetch = Intrinsic::getDeclaration(header->getModule(), Intrinsic::prefetch, ptr->getType());
+        // 参数依次为地址、读/写、局部性（3表示保留在所有cache层级中）、数据/指令cache
+        // 写预取（pldw）需要多处理器扩展，没有时后端会丢弃，改为读预取同样把cache行取进来
+        bool write = G.write && hasPLDW;
+        builder.CreateCall(prefetch, {ptr, builder.getInt32(write), builder.getInt32(3), builder.getInt32(1)});
+        inserted++;
+    }
+    if (inserted) {
+        log("prefetch") << header->getParent()->getName().str() << ": " << header->getName().str() << " "
+                        << inserted << " prefetches, " << itersAhead << " iterations ahead" << std::endl;
+        NumPrefetches += inserted;
+    }
+    return inserted;
+}
+
+PreservedAnalyses PrefetchPass::run(Function &F, FunctionAnalysisManager &FAM) {
+    // ARMv5TE之前没有pld指令，llvm.prefetch会被丢弃
+    const CPUCacheInfo *info = findCPUCacheInfo(targetMachine.getTargetCPU());
+    const MCSubtargetInfo *STI = targetMachine.getMCSubtargetInfo();
+    if (!info || !STI->checkFeatures("+v5te")) {
+        return PreservedAnalyses::all();
+    }
+    bool hasPLDW = STI->checkFeatures("+v7,+mp");
+
+    auto &LI = FAM.getResult<LoopAnalysis>(F);
+    auto &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+    auto &AC = FAM.getResult<AssumptionAnalysis>(F);
+    auto &TTI = FAM.getResult<TargetIRAnalysis>(F);
+
+    bool changed = false;
+    for (Loop *L: LI.getLoopsInPreorder()) {
+        if (L->isInnermost()) {
+            changed |= insertPrefetches(L, *info, hasPLDW, SE, AC, TTI);
+        }
+    }
+    if (!changed) {
+        return PreservedAnalyses::all();
+    }
+    PreservedAnalyses PA;
+    PA.preserveSet<CFGAnalyses>();
+    return PA;
+}
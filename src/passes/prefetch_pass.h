@@ -0,0 +1,21 @@
+#ifndef SYSY_COMPILER_PASSES_PREFETCH_PASS_H
+#define SYSY_COMPILER_PASSES_PREFETCH_PASS_H
+
+#include <llvm/IR/PassManager.h>
+#include <llvm/Target/TargetMachine.h>
+
+// 软件预取：最内层循环中地址按固定步长变化的访存（如按列遍历大数组的a[j][i]），
+// 在访存前插入llvm.prefetch，预取若干次迭代之后要访问的地址，由后端生成pld指令
+// 预取的提前量 = 目标CPU的访存延迟（以指令数计）/ 循环体的指令数，
+// 延迟、cache行大小和需要预取的最小步长按-mcpu=选择的CPU查表，硬件预取器能跟上的小步长访问不预取
+// 同一cache行内的多个访问只预取一次；能放进L1 cache的数组、迭代次数不足提前量的循环不预取
+class PrefetchPass : public llvm::PassInfoMixin<PrefetchPass> {
+    const llvm::TargetMachine &targetMachine;
+
+public:
+    explicit PrefetchPass(const llvm::TargetMachine &targetMachine) : targetMachine(targetMachine) {}
+
+    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+};
+
+#endif //SYSY_COMPILER_PASSES_PREFETCH_PASS_H
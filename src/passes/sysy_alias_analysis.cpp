@@ -0,0 +1,173 @@
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include "sysy_alias_analysis.h"
+
+using namespace llvm;
+
+AnalysisKey ArgPointsToAnalysis::Key;
+AnalysisKey SysYAA::Key;
+
+// 函数的所有使用都是直接调用时，才能通过调用点推导参数的指向
+static bool hasOnlyDirectCalls(const Function &F) {
+    for (const Use &U : F.uses()) {
+        auto *CB = dyn_cast<CallBase>(U.getUser());
+        if (!CB || !CB->isCallee(&U)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const SmallPtrSetImpl<const Value *> *
+ArgPointsToAnalysis::Result::getPointsTo(const Argument *arg) const {
+    auto it = pointsTo.find(arg);
+    return it == pointsTo.end() ? nullptr : &it->second;
+}
+
+bool ArgPointsToAnalysis::Result::getObjects(
+        const Value *ptr,
+        SmallPtrSetImpl<const Value *> &objects
+) const {
+    // 穿过GEP、PHI、select找到指针的所有基对象
+    SmallVector<const Value *, 4> underlying;
+    getUnderlyingObjects(ptr, underlying, nullptr, 0);
+
+    for (const Value *obj: underlying) {
+        if (isa<GlobalVariable>(obj) || isa<AllocaInst>(obj)) {
+            objects.insert(obj);
+        } else if (auto *arg = dyn_cast<Argument>(obj)) {
+            auto *argObjects = getPointsTo(arg);
+            if (!argObjects) {
+                return false;
+            }
+            objects.insert(argObjects->begin(), argObjects->end());
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ArgPointsToAnalysis::Result::invalidate(
+        Module &M,
+        const PreservedAnalyses &PA,
+        ModuleAnalysisManager::Invalidator &
+) {
+    // 与GlobalsAA相同，被函数级分析引用的模块级结果只能显式失效
+    // 改变调用关系的pass之后需要使用InvalidateAnalysisPass重新计算
+    auto PAC = PA.getChecker<ArgPointsToAnalysis>();
+    return !PAC.preservedWhenStateless();
+}
+
+ArgPointsToAnalysis::Result ArgPointsToAnalysis::run(Module &M, ModuleAnalysisManager &AM) {
+    Result result;
+
+    // 候选：只被直接调用的内部函数的指针参数，初始时指向空集
+    for (Function &F: M) {
+        if (F.isDeclaration() || !F.hasLocalLinkage() || !hasOnlyDirectCalls(F)) {
+            continue;
+        }
+        for (Argument &arg: F.args()) {
+            if (arg.getType()->isPointerTy()) {
+                result.pointsTo[&arg];
+            }
+        }
+    }
+
+    // 不动点迭代：用所有调用点的实参指向集合更新形参，实参指向未知时形参也变为未知
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Function &F: M) {
+            for (Argument &arg: F.args()) {
+                auto it = result.pointsTo.find(&arg);
+                if (it == result.pointsTo.end()) {
+                    continue;
+                }
+
+                for (User *U: F.users()) {
+                    auto *CB = cast<CallBase>(U);
+                    SmallPtrSet<const Value *, 4> objects;
+                    if (!result.getObjects(CB->getArgOperand(arg.getArgNo()), objects)) {
+                        result.pointsTo.erase(it);
+                        changed = true;
+                        break;
+                    }
+                    for (const Value *obj: objects) {
+                        changed |= it->second.insert(obj).second;
+                    }
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+// 获取对象的标量元素类型（剥去数组类型），只识别int和float
+static Type *getObjectElementType(const Value *obj) {
+    Type *type;
+    if (auto *GV = dyn_cast<GlobalVariable>(obj)) {
+        type = GV->getValueType();
+    } else if (auto *AI = dyn_cast<AllocaInst>(obj)) {
+        type = AI->getAllocatedType();
+    } else if (auto *arg = dyn_cast<Argument>(obj); arg && arg->getType()->isPointerTy()) {
+        type = arg->getType()->getPointerElementType();
+    } else {
+        return nullptr;
+    }
+
+    while (auto *arrayType = dyn_cast<ArrayType>(type)) {
+        type = arrayType->getElementType();
+    }
+    return type->isIntegerTy(32) || type->isFloatTy() ? type : nullptr;
+}
+
+AliasResult SysYAAResult::alias(const MemoryLocation &LocA,
+                                const MemoryLocation &LocB,
+                                AAQueryInfo &AAQI) {
+    const Value *objA = getUnderlyingObject(LocA.Ptr, 0);
+    const Value *objB = getUnderlyingObject(LocB.Ptr, 0);
+
+    // int数组和float数组不可能是同一个对象
+    Type *typeA = getObjectElementType(objA);
+    Type *typeB = getObjectElementType(objB);
+    if (typeA && typeB && typeA != typeB) {
+        return AliasResult::NoAlias;
+    }
+
+    // 不同的全局变量、局部变量互不别名
+    auto isIdentified = [](const Value *obj) {
+        return isa<GlobalVariable>(obj) || isa<AllocaInst>(obj);
+    };
+    if (objA != objB && isIdentified(objA) && isIdentified(objB)) {
+        return AliasResult::NoAlias;
+    }
+
+    // 数组参数：比较两侧可能指向的对象集合
+    if (argPointsTo && objA != objB && (isa<Argument>(objA) || isa<Argument>(objB))) {
+        SmallPtrSet<const Value *, 8> objectsA, objectsB;
+        if (argPointsTo->getObjects(objA, objectsA) &&
+            argPointsTo->getObjects(objB, objectsB) &&
+            llvm::none_of(objectsA, [&](const Value *obj) { return objectsB.count(obj); })) {
+            return AliasResult::NoAlias;
+        }
+    }
+
+    return AAResultBase::alias(LocA, LocB, AAQI);
+}
+
+SysYAAResult SysYAA::run(Function &F, FunctionAnalysisManager &AM) {
+    // 函数级分析只能使用模块级分析的缓存结果，需要在管道中提前计算ArgPointsToAnalysis
+    // 只有缓存了结果时才能登记失效依赖，否则模块级分析失效时会查找不存在的结果
+    auto &MAMProxy = AM.getResult<ModuleAnalysisManagerFunctionProxy>(F);
+    auto *argPointsTo = MAMProxy.getCachedResult<ArgPointsToAnalysis>(*F.getParent());
+    if (argPointsTo) {
+        MAMProxy.registerOuterAnalysisInvalidation<ArgPointsToAnalysis, SysYAA>();
+    }
+    return SysYAAResult(argPointsTo);
+}
@@ -0,0 +1,68 @@
+#ifndef SYSY_COMPILER_PASSES_SYSY_ALIAS_ANALYSIS_H
+#define SYSY_COMPILER_PASSES_SYSY_ALIAS_ANALYSIS_H
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/IR/PassManager.h>
+
+// 数组参数的指向分析（模块级）
+// SysY中没有函数指针，内部函数的所有调用点都是可见的，因此可以通过调用点
+// 求出每个数组参数可能指向的对象（全局数组或调用者的局部数组）
+class ArgPointsToAnalysis : public llvm::AnalysisInfoMixin<ArgPointsToAnalysis> {
+    friend llvm::AnalysisInfoMixin<ArgPointsToAnalysis>;
+
+    static llvm::AnalysisKey Key;
+
+public:
+    class Result {
+        friend ArgPointsToAnalysis;
+
+        // 参数 -> 可能指向的对象集合，不在表中的参数指向未知
+        llvm::DenseMap<const llvm::Argument *, llvm::SmallPtrSet<const llvm::Value *, 4>> pointsTo;
+
+    public:
+        // 获取指针参数可能指向的对象集合，未知时返回nullptr
+        const llvm::SmallPtrSetImpl<const llvm::Value *> *
+        getPointsTo(const llvm::Argument *arg) const;
+
+        // 获取指针可能指向的对象集合（全局变量/alloca/已知参数），未知时返回false
+        bool getObjects(const llvm::Value *ptr,
+                        llvm::SmallPtrSetImpl<const llvm::Value *> &objects) const;
+
+        bool invalidate(llvm::Module &M, const llvm::PreservedAnalyses &PA,
+                        llvm::ModuleAnalysisManager::Invalidator &);
+    };
+
+    Result run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+};
+
+// SysY语义下的别名分析
+// 1. int数组和float数组一定不是同一个对象（SysY中没有指针类型转换）
+// 2. 不同的全局数组、局部数组与全局数组互不别名
+// 3. 数组参数可能指向的对象集合不相交时互不别名（依赖ArgPointsToAnalysis的缓存结果）
+class SysYAAResult : public llvm::AAResultBase<SysYAAResult> {
+    const ArgPointsToAnalysis::Result *argPointsTo;
+
+public:
+    explicit SysYAAResult(const ArgPointsToAnalysis::Result *argPointsTo)
+            : argPointsTo(argPointsTo) {}
+
+    llvm::AliasResult alias(const llvm::MemoryLocation &LocA,
+                            const llvm::MemoryLocation &LocB,
+                            llvm::AAQueryInfo &AAQI);
+};
+
+// 注册在FunctionAnalysisManager中的别名分析，通过AAManager参与别名查询
+class SysYAA : public llvm::AnalysisInfoMixin<SysYAA> {
+    friend llvm::AnalysisInfoMixin<SysYAA>;
+
+    static llvm::AnalysisKey Key;
+
+public:
+    using Result = SysYAAResult;
+
+    SysYAAResult run(llvm::Function &F, llvm::FunctionAnalysisManager &AM);
+};
+
+#endif //SYSY_COMPILER_PASSES_SYSY_ALIAS_ANALYSIS_H
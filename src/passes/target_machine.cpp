@@ -0,0 +1,116 @@
+#include <stdexcept>
+#include <vector>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/ARMTargetParser.h>
+#include <llvm/Support/TargetSelect.h>
+#include "log.h"
+#include "target_machine.h"
+
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(const TargetOptions &options) {
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmParsers();
+    llvm::InitializeAllAsmPrinters();
+
+    // -march=：体现在三元组的子架构上，例如armv7-a对应armv7-unknown-linux-gnu
+    std::string triple = "arm-unknown-linux-gnu";
+    std::string CPU = options.cpu.empty() ? "generic" : options.cpu;
+    if (!options.arch.empty()) {
+        llvm::ARM::ArchKind archKind = llvm::ARM::parseArch(options.arch);
+        if (archKind == llvm::ARM::ArchKind::INVALID) {
+            throw std::invalid_argument("unknown target architecture: " + options.arch);
+        }
+        triple = ("arm" + llvm::ARM::getSubArch(archKind) + "-unknown-linux-gnu").str();
+        if (options.cpu.empty()) {
+            CPU = llvm::ARM::getDefaultCPU(options.arch).str();
+        }
+    }
+
+    std::string err;
+    auto target = llvm::TargetRegistry::lookupTarget(triple, err);
+    if (!target) {
+        throw std::logic_error(err);
+    }
+
+    std::unique_ptr<llvm::MCSubtargetInfo> STI(target->createMCSubtargetInfo(triple, "", ""));
+    if (!STI->isCPUStringValid(CPU)) {
+        throw std::invalid_argument("unknown target cpu: " + CPU);
+    }
+
+    // -mfloat-abi=：soft完全使用软件浮点，softfp使用浮点指令但按整数寄存器传参，hard使用浮点寄存器传参
+    std::string floatABI = options.floatABI;
+    if (floatABI.empty()) {
+#ifdef CONF_HARD_FLOAT
+        floatABI = "hard";
+#else
+        floatABI = "soft";
+#endif
+    }
+
+    std::vector<llvm::StringRef> features;
+    llvm::TargetOptions opt;
+    if (floatABI == "soft") {
+        opt.FloatABIType = llvm::FloatABI::Soft;
+        llvm::ARM::getFPUFeatures(llvm::ARM::FK_NONE, features);
+        features.push_back("+soft-float");
+    } else if (floatABI == "softfp") {
+        opt.FloatABIType = llvm::FloatABI::Soft;
+    } else if (floatABI == "hard") {
+        opt.FloatABIType = llvm::FloatABI::Hard;
+    } else {
+        throw std::invalid_argument("unknown float abi: " + floatABI);
+    }
+
+    // -mfpu=：在CPU默认的浮点单元之上覆盖，软件浮点时忽略
+    if (!options.fpu.empty() && floatABI != "soft") {
+        unsigned fpuKind = llvm::ARM::parseFPU(options.fpu);
+        if (fpuKind == llvm::ARM::FK_INVALID) {
+            throw std::invalid_argument("unknown fpu: " + options.fpu);
+        }
+        llvm::ARM::getFPUFeatures(fpuKind, features);
+    }
+
+    std::string featureString = llvm::join(features, ",");
+    std::unique_ptr<llvm::TargetMachine> targetMachine(
+            target->createTargetMachine(triple, CPU, featureString, opt, {})
+    );
+
+    log("target") << triple << ", cpu " << CPU << ", float abi " << floatABI
+                  << ", features \"" << featureString << "\"" << std::endl;
+    return targetMachine;
+}
+
+// cache参数来自各CPU的技术参考手册，延迟按访问内存约100~150ns、各核常见的主频和每周期执行的指令数估算
+static const CPUCacheInfo cacheTable[] = {
+        // 没有L1数据预取器（A8）或默认不开启（A9）的核，连续的访问也需要预取
+        {"cortex-a8", 64, 32 * 1024, 120, 1},
+        {"cortex-a9", 32, 32 * 1024, 150, 1},
+        // 其余的核能识别连续和小步长的访问，只预取每次迭代都跨过cache行的访问
+        {"cortex-a7", 64, 32 * 1024, 100, 64},
+        {"cortex-a53", 64, 32 * 1024, 150, 64},
+        {"cortex-a55", 64, 32 * 1024, 150, 64},
+        {"cortex-a15", 64, 32 * 1024, 300, 64},
+        {"cortex-a17", 64, 32 * 1024, 250, 64},
+        {"cortex-a57", 64, 32 * 1024, 300, 64},
+        {"cortex-a72", 64, 32 * 1024, 300, 64},
+        {"cortex-a73", 64, 64 * 1024, 300, 64},
+        // 只指定-march=时按常见的Cortex-A核取中间值
+        {"generic", 64, 32 * 1024, 200, 64},
+};
+
+const CPUCacheInfo *findCPUCacheInfo(llvm::StringRef cpu) {
+    for (const CPUCacheInfo &info: cacheTable) {
+        if (cpu == info.cpu) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+const CPUCacheInfo &getCPUCacheInfo(const llvm::TargetMachine &targetMachine) {
+    const CPUCacheInfo *info = findCPUCacheInfo(targetMachine.getTargetCPU());
+    return info ? *info : *findCPUCacheInfo("generic");
+}
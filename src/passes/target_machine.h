@@ -0,0 +1,39 @@
+#ifndef SYSY_COMPILER_PASSES_TARGET_MACHINE_H
+#define SYSY_COMPILER_PASSES_TARGET_MACHINE_H
+
+#include <memory>
+#include <string>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Target/TargetMachine.h>
+
+// 目标平台选项，对应命令行的-march=、-mcpu=、-mfpu=、-mfloat-abi=，含义与gcc相同
+// 为空的选项使用默认值：ARM通用CPU，浮点ABI由编译时的HARD_FLOAT选项决定
+struct TargetOptions {
+    std::string arch;
+    std::string cpu;
+    std::string fpu;
+    std::string floatABI;
+};
+
+// 根据目标平台选项创建TargetMachine，选项无效时抛出std::invalid_argument
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(const TargetOptions &options);
+
+// 目标CPU的cache模型，全局布局、循环分块和软件预取共用
+struct CPUCacheInfo {
+    const char *cpu;
+    // L1数据cache的行大小和容量（字节）
+    unsigned lineSize;
+    unsigned L1Size;
+    // 一次访存未命中的延迟内可以执行的指令数
+    unsigned prefetchDistance;
+    // 步长（字节）不小于它的访问才需要软件预取，更小的步长由硬件预取器处理
+    unsigned prefetchMinStride;
+};
+
+// 按CPU名查表，不在表中的CPU返回nullptr
+const CPUCacheInfo *findCPUCacheInfo(llvm::StringRef cpu);
+
+// TargetMachine所选CPU的cache模型，不在表中的CPU使用通用的参数
+const CPUCacheInfo &getCPUCacheInfo(const llvm::TargetMachine &targetMachine);
+
+#endif //SYSY_COMPILER_PASSES_TARGET_MACHINE_H
@@ -0,0 +1,119 @@
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/DependenceAnalysis.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/OptimizationRemarkEmitter.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Transforms/Utils/LoopSimplify.h>
+#include <llvm/Transforms/Utils/LoopUtils.h>
+#include <llvm/Transforms/Utils/UnrollLoop.h>
+#include "log.h"
+#include "unroll_and_jam_pass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "unroll-and-jam"
+
+STATISTIC(NumUnrolledAndJammed, "Number of loops unrolled and jammed");
+
+// 与LLVM自带的unroll-and-jam-count等选项区分
+static cl::opt<unsigned> MaxCount(
+        "sysy-unroll-and-jam-count", cl::init(4), cl::Hidden,
+        cl::desc("Max unroll count of the outer loop in unroll-and-jam"));
+
+static cl::opt<unsigned> SizeThreshold(
+        "sysy-unroll-and-jam-threshold", cl::init(64), cl::Hidden,
+        cl::desc("Max number of instructions in the jammed inner loop"));
+
+// ARM上可分配的通用寄存器约为12个，合并后内层循环中跨迭代的值不应超过其中的大部分
+static constexpr unsigned MaxLiveValues = 8;
+
+// 内层循环中是否有与外层迭代无关的load，展开合并后可以被各份共用
+static bool hasOuterInvariantLoad(Loop *outer, Loop *inner, ScalarEvolution &SE) {
+    for (BasicBlock *BB: inner->blocks()) {
+        for (Instruction &I: *BB) {
+            // 地址为{start,+,step}<inner>，start和step都与外层迭代无关
+            auto *load = dyn_cast<LoadInst>(&I);
+            auto *AR = load ? dyn_cast<SCEVAddRecExpr>(SE.getSCEV(load->getPointerOperand())) : nullptr;
+            if (AR && AR->getLoop() == inner && SE.isLoopInvariant(AR->getStart(), outer) &&
+                SE.isLoopInvariant(AR->getStepRecurrence(SE), outer)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// 选择展开次数，不值得展开时返回0
+static unsigned getCount(Loop *outer, ScalarEvolution &SE) {
+    Loop *inner = outer->getSubLoops().front();
+    if (!hasOuterInvariantLoad(outer, inner, SE)) {
+        return 0;
+    }
+
+    unsigned size = 0;
+    for (BasicBlock *BB: inner->blocks()) {
+        size += BB->size();
+    }
+    // 每份内层循环都有自己的归约等跨迭代的值（不含归纳变量）
+    unsigned liveValues = std::max<unsigned>(std::distance(inner->getHeader()->phis().begin(),
+                                                           inner->getHeader()->phis().end()), 2) - 1;
+    unsigned tripCount = SE.getSmallConstantTripCount(outer);
+
+    unsigned count = MaxCount;
+    while (count >= 2 && (size * count > SizeThreshold || liveValues * count > MaxLiveValues ||
+                          (tripCount && tripCount < count))) {
+        count /= 2;
+    }
+    return count >= 2 ? count : 0;
+}
+
+PreservedAnalyses UnrollAndJamPass::run(Function &F, FunctionAnalysisManager &FAM) {
+    auto &LI = FAM.getResult<LoopAnalysis>(F);
+    auto &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+    auto &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+    auto &AC = FAM.getResult<AssumptionAnalysis>(F);
+    auto &TTI = FAM.getResult<TargetIRAnalysis>(F);
+    auto &DI = FAM.getResult<DependenceAnalysis>(F);
+    auto &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+
+    // 只处理内层为最内层循环的两层嵌套，各个候选互不包含
+    SmallVector<Loop *, 8> candidates;
+    for (Loop *L: LI.getLoopsInPreorder()) {
+        if (L->getSubLoops().size() == 1 && L->getSubLoops().front()->isInnermost()) {
+            candidates.push_back(L);
+        }
+    }
+
+    bool changed = false;
+    for (Loop *L: candidates) {
+        unsigned count = getCount(L, SE);
+        if (!count) {
+            continue;
+        }
+        // 之前的SimplifyCFG可能删除了preheader等结构
+        changed |= simplifyLoop(L, &DT, &LI, &SE, &AC, nullptr, false);
+        changed |= formLCSSARecursively(*L, DT, &LI, &SE);
+        if (!isSafeToUnrollAndJam(L, SE, DT, DI, LI)) {
+            continue;
+        }
+
+        std::string header = L->getHeader()->getName().str();
+        LoopUnrollResult result = UnrollAndJamLoop(
+                L, count, SE.getSmallConstantTripCount(L), SE.getSmallConstantTripMultiple(L),
+                false, &LI, &SE, &DT, &AC, &TTI, &ORE
+        );
+        if (result == LoopUnrollResult::Unmodified) {
+            continue;
+        }
+        log("unroll-and-jam") << F.getName().str() << ": " << header << " by " << count << std::endl;
+        NumUnrolledAndJammed++;
+        changed = true;
+    }
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
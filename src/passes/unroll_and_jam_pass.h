@@ -0,0 +1,16 @@
+#ifndef SYSY_COMPILER_PASSES_UNROLL_AND_JAM_PASS_H
+#define SYSY_COMPILER_PASSES_UNROLL_AND_JAM_PASS_H
+
+#include <llvm/IR/PassManager.h>
+
+// 外层循环的展开合并（unroll-and-jam）：两层的循环嵌套中，内层循环读取的某个值与外层迭代无关时
+// （如矩阵乘法中的a[i][k]对j不变），将外层展开若干次并把各份内层循环合并为一个，
+// 这个值只需读取一次就可以被各份共用，外层相邻迭代的访存也落在同一cache行中
+// 展开次数受内层循环的规模和各份中跨迭代的值（归约）占用的寄存器数限制
+// 合法性检查和变换使用LLVM的UnrollAndJamLoop
+class UnrollAndJamPass : public llvm::PassInfoMixin<UnrollAndJamPass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+};
+
+#endif //SYSY_COMPILER_PASSES_UNROLL_AND_JAM_PASS_H
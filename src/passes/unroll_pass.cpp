@@ -0,0 +1,203 @@
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/CodeMetrics.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/OptimizationRemarkEmitter.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Transforms/Utils/LoopSimplify.h>
+#include <llvm/Transforms/Utils/LoopUtils.h>
+#include <llvm/Transforms/Utils/UnrollLoop.h>
+#include "log.h"
+#include "unroll_pass.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "sysy-unroll"
+
+STATISTIC(NumFullyUnrolled, "Number of loops fully unrolled");
+STATISTIC(NumPartiallyUnrolled, "Number of loops with a constant trip count partially unrolled");
+STATISTIC(NumRuntimeUnrolled, "Number of loops unrolled with a runtime remainder loop");
+
+// ARM的Cortex-A系列L1指令cache为16~32KB，完全展开后的循环按每条IR指令约4字节估算不超过约1KB
+static cl::opt<unsigned> FullThreshold(
+        "sysy-unroll-full-threshold", cl::init(160), cl::Hidden,
+        cl::desc("Max number of instructions of a fully unrolled loop"));
+
+static cl::opt<unsigned> FullMaxCount(
+        "sysy-unroll-full-max-count", cl::init(32), cl::Hidden,
+        cl::desc("Max trip count of a fully unrolled loop"));
+
+// 部分展开和运行时展开后的循环体应留在分支预测器和循环缓冲能覆盖的范围内
+static cl::opt<unsigned> PartialThreshold(
+        "sysy-unroll-threshold", cl::init(64), cl::Hidden,
+        cl::desc("Max number of instructions of a partially unrolled loop body"));
+
+// 使用的是基本寄存器分配器，展开次数过多时各份中的值会溢出到栈上
+static cl::opt<unsigned> MaxCount(
+        "sysy-unroll-max-count", cl::init(4), cl::Hidden,
+        cl::desc("Max unroll count of partial and runtime unrolling"));
+
+static cl::list<std::string> FunctionCounts(
+        "sysy-unroll-function", cl::Hidden, cl::CommaSeparated,
+        cl::desc("Unroll count of the loops in a function, as name:count"));
+
+// 解析-sysy-unroll-function中为各函数指定的展开次数
+static std::map<std::string, unsigned> parseFunctionCounts() {
+    std::map<std::string, unsigned> counts;
+    for (const std::string &entry: FunctionCounts) {
+        auto [name, countStr] = StringRef(entry).rsplit(':');
+        unsigned count;
+        if (name.empty() || countStr.getAsInteger(10, count) || count == 0) {
+            throw std::invalid_argument("-sysy-unroll-function: invalid entry " + entry + ", expected name:count");
+        }
+        counts[name.str()] = count;
+    }
+    return counts;
+}
+
+// 用户指定的展开次数：循环上的llvm.loop.unroll.count元数据，禁止展开时为1
+static std::optional<unsigned> getUserCount(Loop *L) {
+    if (hasUnrollTransformation(L) == TM_Disable) {
+        return 1;
+    }
+    MDNode *loopID = L->getLoopID();
+    if (MDNode *MD = loopID ? GetUnrollMetadata(loopID, "llvm.loop.unroll.count") : nullptr) {
+        return std::max<unsigned>(mdconst::extract<ConstantInt>(MD->getOperand(1))->getZExtValue(), 1);
+    }
+    return std::nullopt;
+}
+
+// 不超过MaxCount、展开后不超过阈值的最大的2的幂，tripCount非0时还须整除迭代次数
+static unsigned getPartialCount(unsigned size, unsigned tripCount) {
+    unsigned count = PowerOf2Floor(std::max<unsigned>(MaxCount, 1));
+    while (count >= 2 && (size * count > PartialThreshold || (tripCount && tripCount % count))) {
+        count /= 2;
+    }
+    return count;
+}
+
+PreservedAnalyses UnrollFunctionCountPass::run(Module &M, ModuleAnalysisManager &AM) {
+    std::map<std::string, unsigned> functionCounts = parseFunctionCounts();
+    if (functionCounts.empty()) {
+        return PreservedAnalyses::all();
+    }
+
+    auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    for (const auto &[name, count]: functionCounts) {
+        Function *F = M.getFunction(name);
+        if (!F || F->isDeclaration()) {
+            throw std::invalid_argument("-sysy-unroll-function: no function named " + name);
+        }
+        // 已有的展开次数元数据会被替换
+        for (Loop *L: FAM.getResult<LoopAnalysis>(*F).getLoopsInPreorder()) {
+            addStringMetadataToLoop(L, "llvm.loop.unroll.count", count);
+        }
+        log("unroll") << name << ": loops annotated with unroll count " << count << std::endl;
+    }
+    // 元数据只挂在循环的latch分支上，不改变CFG和指令
+    return PreservedAnalyses::all();
+}
+
+PreservedAnalyses UnrollPass::run(Function &F, FunctionAnalysisManager &FAM) {
+    auto &LI = FAM.getResult<LoopAnalysis>(F);
+    auto &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+    auto &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+    auto &AC = FAM.getResult<AssumptionAnalysis>(F);
+    auto &TTI = FAM.getResult<TargetIRAnalysis>(F);
+    auto &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+
+    // 子循环排在父循环之前，内层循环完全展开后父循环成为最内层，轮到它时同样可以展开
+    SmallVector<Loop *, 16> worklist(LI.getLoopsInPreorder());
+    std::reverse(worklist.begin(), worklist.end());
+
+    bool changed = false;
+    for (Loop *L: worklist) {
+        if (!L->isInnermost()) {
+            continue;
+        }
+        std::optional<unsigned> userCount = getUserCount(L);
+        if (userCount == 1u) {
+            continue;
+        }
+        // 之前的SimplifyCFG和向量化可能删除了preheader等结构
+        if (!L->isLoopSimplifyForm()) {
+            changed |= simplifyLoop(L, &DT, &LI, &SE, &AC, nullptr, false);
+        }
+        if (!L->isLoopSimplifyForm() || !L->isSafeToClone()) {
+            continue;
+        }
+
+        SmallPtrSet<const Value *, 32> ephValues;
+        CodeMetrics::collectEphemeralValues(L, &AC, ephValues);
+        CodeMetrics metrics;
+        for (BasicBlock *BB: L->blocks()) {
+            metrics.analyzeBasicBlock(BB, TTI, ephValues);
+        }
+        if (metrics.notDuplicatable || metrics.convergent) {
+            continue;
+        }
+        unsigned size = std::max(metrics.NumInsts, 1u);
+        unsigned tripCount = SE.getSmallConstantTripCount(L);
+        bool vectorized = getBooleanLoopAttribute(L, "llvm.loop.isvectorized");
+
+        unsigned count;
+        bool runtime = false;
+        if (tripCount) {
+            if (userCount) {
+                count = std::min(*userCount, tripCount);
+            } else if (tripCount <= FullMaxCount && tripCount * size <= FullThreshold) {
+                count = tripCount;
+            } else {
+                count = vectorized ? 1 : getPartialCount(size, tripCount);
+            }
+        } else {
+            // 迭代次数在运行时才知道，只展开没有调用的计数循环，剩余的迭代由余数循环执行
+            if (isa<SCEVCouldNotCompute>(SE.getBackedgeTakenCount(L)) || !L->getExitingBlock() ||
+                L->getExitingBlock() != L->getLoopLatch()) {
+                continue;
+            }
+            if (userCount) {
+                count = *userCount;
+            } else if (vectorized || metrics.NumCalls ||
+                       getBooleanLoopAttribute(L, "llvm.loop.unroll.runtime.disable")) {
+                continue;
+            } else {
+                count = getPartialCount(size, 0);
+            }
+            runtime = true;
+        }
+        if (count < 2) {
+            continue;
+        }
+
+        changed |= formLCSSARecursively(*L, DT, &LI, &SE);
+        std::string header = L->getHeader()->getName().str();
+        bool full = count == tripCount;
+        LoopUnrollResult result = UnrollLoop(
+                L, {count, false, runtime, false, false, false},
+                &LI, &SE, &DT, &AC, &TTI, &ORE, true
+        );
+        if (result == LoopUnrollResult::Unmodified) {
+            continue;
+        }
+        changed = true;
+        if (full) {
+            log("unroll") << F.getName().str() << ": " << header << " fully unrolled (" << count << ")" << std::endl;
+            NumFullyUnrolled++;
+        } else if (runtime) {
+            log("unroll") << F.getName().str() << ": " << header << " by " << count << " with remainder" << std::endl;
+            NumRuntimeUnrolled++;
+        } else {
+            log("unroll") << F.getName().str() << ": " << header << " by " << count << std::endl;
+            NumPartiallyUnrolled++;
+        }
+    }
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
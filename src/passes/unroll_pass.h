@@ -0,0 +1,27 @@
+#ifndef SYSY_COMPILER_PASSES_UNROLL_PASS_H
+#define SYSY_COMPILER_PASSES_UNROLL_PASS_H
+
+#include <llvm/IR/PassManager.h>
+
+// 最内层循环的展开，阈值按ARM的代码大小和指令cache设置
+// 完全展开：迭代次数为小常量（如数组维度while (j < 3)），展开后的总规模不超过阈值，
+// 内层循环完全展开后外层循环成为最内层，同样可以被完全展开
+// 部分展开：迭代次数为较大的常量时，按迭代次数的因数展开，不需要余数循环
+// 运行时展开：迭代次数在运行时才知道（如从输入读取的n）时，按展开次数展开并生成余数循环处理剩余的迭代
+// 展开次数由循环上的llvm.loop.unroll.*元数据指定，-mllvm -sysy-unroll-function=函数名:次数
+// 由UnrollFunctionCountPass转换为该函数中各循环上的元数据（次数为1时不展开）
+// 已被向量化的循环由向量化器按交错次数展开过，不再做部分展开和运行时展开
+class UnrollPass : public llvm::PassInfoMixin<UnrollPass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+};
+
+// 把-sysy-unroll-function为各函数指定的展开次数写到函数中各循环的llvm.loop.unroll.count元数据上
+// 需要在内联之前进行，被内联的函数中的循环带着元数据复制到调用者中，指定的次数仍然生效
+// 指定的函数不存在时报告选项错误
+class UnrollFunctionCountPass : public llvm::PassInfoMixin<UnrollFunctionCountPass> {
+public:
+    llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+};
+
+#endif //SYSY_COMPILER_PASSES_UNROLL_PASS_H
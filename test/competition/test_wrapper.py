@@ -1,7 +1,10 @@
 #! /usr/bin/python3
 
 # 使用方式：
-# ./test_wrapper.py <编译器路径> <项目根目录> <测试点相对路径> <-O2>
+# ./test_wrapper.py <编译器路径> <项目根目录> <测试点相对路径> <-O2> <目标平台选项...>
+# 目标平台选项（-march=、-mcpu=、-mfpu=、-mfloat-abi=）等其他参数会原样传给编译器，
+# -mfloat-abi=hard时使用硬浮点的交叉编译器、qemu库路径和运行时库
+# 测试点需要的额外编译选项（例如-mllvm -auto-parallel）写在同名的.args文件中
 
 import sys
 import subprocess
@@ -15,10 +18,28 @@ if __name__ == '__main__':
 
     test_name = test_path.split('/')[-1]
 
+    target_options = [arg for arg in sys.argv[4:] if arg != '-O2']
+    if os.path.exists(test_path + '.args'):
+        with open(test_path + '.args', 'r') as f:
+            target_options += f.read().split()
+    hard_float = '-mfloat-abi=hard' in target_options
+    cross_gcc = 'arm-linux-gnueabihf-gcc' if hard_float else 'arm-linux-gnueabi-gcc'
+    qemu_lib = '/usr/arm-linux-gnueabihf' if hard_float else '/usr/arm-linux-gnueabi'
+
+    # 使用构建目录中对应浮点ABI的运行时库（与编译器位于同一目录）
+    # 仓库中预先编译的runtime_lib/libsysy.a是软浮点的，并且没有并行化和矩阵乘法的入口，不能代替
+    runtime_lib = os.path.join(os.path.dirname(compiler), 'runtime_lib',
+                               'hard' if hard_float else 'soft')
+    if not os.path.exists(os.path.join(runtime_lib, 'libsysy.a')):
+        print('runtime library not found: ' + os.path.join(runtime_lib, 'libsysy.a'))
+        print('install ' + cross_gcc + ' and re-run cmake to build it from runtime_lib/sylib.c')
+        exit(1)
+
     # 编译到汇编文件
     cmd = [compiler, '-S', '-o', '/tmp/' + test_name + '.s', test_path + '.sy']
     if sys.argv.count('-O2') != 0:
         cmd.append('-O2')
+    cmd += target_options
 
     ret = subprocess.run(cmd)
 
@@ -27,13 +48,14 @@ if __name__ == '__main__':
 
     # 编译 & 链接
     cmd = [
-        'arm-linux-gnueabi-gcc',
+        cross_gcc,
         '/tmp/' + test_name + '.s',
         '-o',
         '/tmp/' + test_name + '.bin',
         '-L',
-        home + '/runtime_lib',
+        runtime_lib,
         '-lsysy',
+        '-lpthread',
     ]
 
     ret = subprocess.run(cmd)
@@ -46,7 +68,7 @@ if __name__ == '__main__':
     cmd = [
         'qemu-arm',
         '-L',
-        '/usr/arm-linux-gnueabi',
+        qemu_lib,
         '/tmp/' + test_name + '.bin',
     ]
 